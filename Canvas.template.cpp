@@ -2,14 +2,180 @@
 // Copyright 2010-2015 Fabric Software Inc. All rights reserved.
 //
 
+#include "CanvasBatch.h"
 #include "CanvasMainWindow.h"
+#include "CanvasStartup.h"
+#include "CanvasTrace.h"
 #include <FabricCore.h>
 #include <FabricUI/Style/FabricStyle.h>
 #include <FTL/CStrRef.h>
 #include <FTL/Path.h>
 
+#include <QtCore/QTimer>
+
+#include <stdlib.h>
+#include <string.h>
+
+static void PrintUsage( char const *argv0 )
+{
+  printf(
+    "Usage: %s [-u] [--batch [--frames <in>[:<out>]]] [--recover <autosave>]\n"
+    "          [--trace <trace.json>] [--startup-profile] [--lazy-startup]\n"
+    "          [file.canvas ...]\n"
+    "       %s [-u] --validate [-j <threads>] file.canvas ...\n"
+    "       %s --convert <input> <output>\n"
+    "  -u        run the core in unguarded mode\n"
+    "  --batch   evaluate the graphs without any UI and exit\n"
+    "  --frames  frame range evaluated in batch mode\n"
+    "            (defaults to the range saved with each graph)\n"
+    "  --recover rebuild a graph from an autosave file and its journal\n"
+    "  --trace   record a trace of the session, written on exit in the\n"
+    "            Trace Event Format (chrome://tracing, Perfetto)\n"
+    "  --startup-profile print the time spent in each startup phase\n"
+    "  --lazy-startup create the hidden docks when first shown and load\n"
+    "            the optional extensions after the first frame\n"
+    "            (also the mainWindow/lazyStartup setting)\n"
+    "  --validate load, check and evaluate the graphs in parallel, one\n"
+    "            binding per file, and print a report per file\n"
+    "  -j        number of validation threads (defaults to the core count)\n"
+    "  --convert convert between .canvas and compressed .canvasz files\n",
+    argv0,
+    argv0,
+    argv0
+    );
+}
+
+static int RunValidate(
+  bool unguarded,
+  int threadCount,
+  int argc,
+  char *argv[],
+  int argi
+  )
+{
+  try
+  {
+    BatchRunner runner( unguarded );
+
+    std::vector<std::string> filePaths;
+    for ( ; argi < argc; ++argi )
+      filePaths.push_back( argv[argi] );
+
+    return runner.validate( filePaths, threadCount ) > 0? 1: 0;
+  }
+  catch ( FabricCore::Exception e )
+  {
+    printf("Error running Canvas validation: %s\n", e.getDesc_cstr());
+    return 1;
+  }
+}
+
+static int RunBatch(
+  bool unguarded,
+  bool hasFrameRange,
+  int frameIn,
+  int frameOut,
+  int argc,
+  char *argv[],
+  int argi
+  )
+{
+  try
+  {
+    BatchRunner runner( unguarded );
+    if ( hasFrameRange )
+      runner.setFrameRange( frameIn, frameOut );
+
+    int failures = 0;
+    for ( ; argi < argc; ++argi )
+    {
+      if ( !runner.run( argv[argi] ) )
+        ++failures;
+    }
+    return failures > 0? 1: 0;
+  }
+  catch ( FabricCore::Exception e )
+  {
+    printf("Error running Canvas batch: %s\n", e.getDesc_cstr());
+    return 1;
+  }
+}
+
 int main(int argc, char *argv[])
 {
+  // started before anything else, and only reported when requested
+  StartupProfiler startupProfiler;
+
+  int argi = 1;
+
+  bool unguarded = false;
+  bool batch = false;
+  bool validate = false;
+  int threadCount = 0;
+  bool hasFrameRange = false;
+  char const *recoverFilePath = NULL;
+  char const *traceFilePath = NULL;
+  bool profileStartup = false;
+  bool lazyStartup = false;
+  int frameIn = TimeRange_Default_Frame_In;
+  int frameOut = TimeRange_Default_Frame_Out;
+  for ( ; argi < argc; ++argi )
+  {
+    FTL::CStrRef arg( argv[argi] );
+    if ( arg == FTL_STR("-u") )
+    {
+      printf("Running core in UNGUARDED mode\n");
+      unguarded = true;
+    }
+    else if ( arg == FTL_STR("--batch") )
+      batch = true;
+    else if ( arg == FTL_STR("--validate") )
+      validate = true;
+    else if ( arg == FTL_STR("-j") && argi + 1 < argc )
+      threadCount = atoi( argv[++argi] );
+    else if ( arg == FTL_STR("--frames") && argi + 1 < argc )
+    {
+      char const *range = argv[++argi];
+      char const *colon = strchr( range, ':' );
+      frameIn = atoi( range );
+      frameOut = colon? atoi( colon + 1 ): frameIn;
+      hasFrameRange = true;
+    }
+    else if ( arg == FTL_STR("--convert") )
+    {
+      if ( argi + 2 >= argc )
+      {
+        PrintUsage( argv[0] );
+        return 1;
+      }
+      return ConvertCanvasFile( argv[argi + 1], argv[argi + 2] )? 0: 1;
+    }
+    else if ( arg == FTL_STR("--recover") && argi + 1 < argc )
+      recoverFilePath = argv[++argi];
+    else if ( arg == FTL_STR("--trace") && argi + 1 < argc )
+      traceFilePath = argv[++argi];
+    else if ( arg == FTL_STR("--startup-profile") )
+      profileStartup = true;
+    else if ( arg == FTL_STR("--lazy-startup") )
+      lazyStartup = true;
+    else if ( arg == FTL_STR("-h") || arg == FTL_STR("--help") )
+    {
+      PrintUsage( argv[0] );
+      return 0;
+    }
+    else
+      break;
+  }
+
+  // batch and validation modes must not touch the display, so they
+  // run before the QApplication is constructed
+  if ( validate )
+    return RunValidate( unguarded, threadCount, argc, argv, argi );
+  if ( batch )
+    return RunBatch(
+      unguarded, hasFrameRange, frameIn, frameOut, argc, argv, argi
+      );
+
   QApplication app(argc, argv);
   app.setOrganizationName( "{{FABRIC_COMPANY_NAME_NO_INC}}" );
   app.setApplicationName( "Fabric Canvas Standalone" );
@@ -24,26 +190,42 @@ int main(int argc, char *argv[])
     app.setWindowIcon( QIcon( logoPath.c_str() ) );
   }
 
+  if ( traceFilePath )
+    TraceRecorder::Start();
+
   QSettings settings;
+  startupProfiler.mark( "application" );
   try
   {
-    int argi = 1;
-
-    bool unguarded = false;
-    if ( argi < argc && FTL::CStrRef(argv[argi]) == FTL_STR("-u") )
-    {
-      printf("Running core in UNGUARDED mode\n");
-      unguarded = true;
-      ++argi;
-    }
+    MainWindowOptions options;
+    options.unguarded = unguarded;
+    options.lazyStartup =
+      lazyStartup || settings.value( "mainWindow/lazyStartup", false ).toBool();
+    if ( profileStartup )
+      options.startupProfiler = &startupProfiler;
 
-    MainWindow mainWin( &settings, unguarded );
+    MainWindow mainWin( &settings, options );
     mainWin.show();
+    startupProfiler.mark( "show" );
+
+    if ( recoverFilePath )
+      mainWin.recoverAutosave( recoverFilePath );
 
     for ( ; argi < argc; ++argi )
       mainWin.loadGraph( argv[argi] );
+    startupProfiler.mark( "loadGraphs" );
+
+    // runs once the pending paint events have been processed
+    QTimer::singleShot( 0, &mainWin, SLOT(onStartupFinished()) );
+
+    int result = app.exec();
+
+    // the recording may have been stopped from the menu already
+    if ( traceFilePath && TraceRecorder::IsRecording()
+      && !TraceRecorder::Stop( traceFilePath ) )
+      printf("Error: unable to write %s\n", traceFilePath);
 
-    return app.exec();
+    return result;
   }
   catch ( FabricCore::Exception e )
   {
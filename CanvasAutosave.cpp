@@ -0,0 +1,309 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasAutosave.h"
+#include "CanvasFile.h"
+#include "CanvasTrace.h"
+
+#include <FTL/FS.h>
+
+#include <QtCore/QtConcurrentRun>
+
+#include <stdio.h>
+#include <string.h>
+
+static const char sJournalMagic[4] = { 'C', 'N', 'V', 'J' };
+static const char sRecordMagic[4] = { 'C', 'N', 'V', 'R' };
+static const uint32_t sJournalVersion = 1;
+
+// FNV-1a
+static uint64_t HashBytes( char const *data, size_t size )
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for ( size_t i = 0; i < size; ++i )
+  {
+    hash ^= uint8_t( data[i] );
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+template<typename T>
+static void AppendPOD( std::string &out, T value )
+{
+  out.append( reinterpret_cast<char const *>( &value ), sizeof( T ) );
+}
+
+template<typename T>
+static bool ReadPOD( char const *&cursor, char const *end, T &value )
+{
+  if ( size_t( end - cursor ) < sizeof( T ) )
+    return false;
+  memcpy( &value, cursor, sizeof( T ) );
+  cursor += sizeof( T );
+  return true;
+}
+
+static bool ReadBytes(
+  char const *&cursor,
+  char const *end,
+  uint64_t size,
+  char const *&bytes
+  )
+{
+  if ( uint64_t( end - cursor ) < size )
+    return false;
+  bytes = cursor;
+  cursor += size;
+  return true;
+}
+
+AutosaveJournal::AutosaveJournal( std::string const &checkpointFilePath )
+  : m_checkpointFilePath( checkpointFilePath )
+  , m_journalFilePath( JournalFilePath( checkpointFilePath ) )
+  , m_hasCheckpoint( false )
+  , m_journalSize( 0 )
+  , m_recordCount( 0 )
+{
+}
+
+std::string AutosaveJournal::JournalFilePath(
+  std::string const &checkpointFilePath
+  )
+{
+  std::string journalFilePath = checkpointFilePath;
+  journalFilePath += ".journal";
+  return journalFilePath;
+}
+
+bool AutosaveJournal::write(
+  char const *data,
+  uint32_t size,
+  std::string const &label
+  )
+{
+  if ( !m_hasCheckpoint
+    || m_recordCount >= s_maxRecordCount
+    || m_journalSize * 100 > uint64_t( size ) * s_maxJournalRatioPercent )
+    return writeCheckpoint( data, size );
+
+  // the edit is whatever lies between the common prefix and suffix
+  size_t oldSize = m_document.size();
+  size_t maxCommon = oldSize < size? oldSize: size;
+  size_t prefixSize = 0;
+  while ( prefixSize < maxCommon && m_document[prefixSize] == data[prefixSize] )
+    ++prefixSize;
+  size_t suffixSize = 0;
+  while ( suffixSize < maxCommon - prefixSize
+    && m_document[oldSize - 1 - suffixSize] == data[size - 1 - suffixSize] )
+    ++suffixSize;
+
+  uint64_t removedSize = oldSize - prefixSize - suffixSize;
+  uint64_t insertedSize = size - prefixSize - suffixSize;
+  if ( removedSize == 0 && insertedSize == 0 )
+    return true;
+
+  std::string record;
+  record.append( sRecordMagic, sizeof( sRecordMagic ) );
+  AppendPOD<uint64_t>( record, prefixSize );
+  AppendPOD<uint64_t>( record, removedSize );
+  AppendPOD<uint64_t>( record, insertedSize );
+  AppendPOD<uint32_t>( record, uint32_t( label.size() ) );
+  record += label;
+  record.append( data + prefixSize, size_t( insertedSize ) );
+  AppendPOD<uint64_t>( record, HashBytes( data, size ) );
+
+  FILE *file = fopen( m_journalFilePath.c_str(), "ab" );
+  if ( !file )
+    return false;
+  bool succeeded =
+    fwrite( record.data(), 1, record.size(), file ) == record.size();
+  if ( fflush( file ) != 0 )
+    succeeded = false;
+  fclose( file );
+
+  if ( !succeeded )
+  {
+    // the journal may end with a partial record; start over from
+    // a fresh checkpoint next time
+    m_hasCheckpoint = false;
+    return false;
+  }
+
+  m_document.assign( data, size );
+  m_journalSize += record.size();
+  ++m_recordCount;
+  return true;
+}
+
+bool AutosaveJournal::writeCheckpoint(
+  char const *data,
+  uint32_t size
+  )
+{
+  m_hasCheckpoint = false;
+
+  if ( !WriteFileAtomically( m_checkpointFilePath, data, size ) )
+    return false;
+
+  // a crash between the two writes leaves a journal whose header does not
+  // match the new checkpoint, which Replay() then ignores
+  std::string header;
+  header.append( sJournalMagic, sizeof( sJournalMagic ) );
+  AppendPOD<uint32_t>( header, sJournalVersion );
+  AppendPOD<uint64_t>( header, size );
+  AppendPOD<uint64_t>( header, HashBytes( data, size ) );
+  if ( !WriteFileAtomically( m_journalFilePath, header.data(), header.size() ) )
+    return false;
+
+  m_document.assign( data, size );
+  m_hasCheckpoint = true;
+  m_journalSize = header.size();
+  m_recordCount = 0;
+  return true;
+}
+
+void AutosaveJournal::remove()
+{
+  FTL::FSMaybeDeleteFile( m_journalFilePath );
+  FTL::FSMaybeDeleteFile( m_checkpointFilePath );
+  m_document.clear();
+  m_hasCheckpoint = false;
+}
+
+bool AutosaveJournal::Replay(
+  std::string const &checkpointFilePath,
+  std::string &document,
+  std::string *lastLabel
+  )
+{
+  MappedFile checkpoint;
+  if ( !checkpoint.open( checkpointFilePath.c_str() ) )
+    return false;
+  document.assign( checkpoint.data(), size_t( checkpoint.size() ) );
+  checkpoint.close();
+
+  MappedFile journal;
+  if ( !journal.open( JournalFilePath( checkpointFilePath ).c_str() ) )
+    return true;
+
+  char const *cursor = journal.data();
+  char const *end = cursor + journal.size();
+
+  char const *magic;
+  uint32_t version;
+  uint64_t checkpointSize;
+  uint64_t checkpointHash;
+  if ( !ReadBytes( cursor, end, sizeof( sJournalMagic ), magic )
+    || memcmp( magic, sJournalMagic, sizeof( sJournalMagic ) ) != 0
+    || !ReadPOD( cursor, end, version )
+    || version != sJournalVersion
+    || !ReadPOD( cursor, end, checkpointSize )
+    || !ReadPOD( cursor, end, checkpointHash )
+    || checkpointSize != document.size()
+    || checkpointHash != HashBytes( document.data(), document.size() ) )
+    return true;
+
+  while ( cursor < end )
+  {
+    uint64_t offset;
+    uint64_t removedSize;
+    uint64_t insertedSize;
+    uint32_t labelSize;
+    char const *label;
+    char const *inserted;
+    uint64_t resultHash;
+    if ( !ReadBytes( cursor, end, sizeof( sRecordMagic ), magic )
+      || memcmp( magic, sRecordMagic, sizeof( sRecordMagic ) ) != 0
+      || !ReadPOD( cursor, end, offset )
+      || !ReadPOD( cursor, end, removedSize )
+      || !ReadPOD( cursor, end, insertedSize )
+      || !ReadPOD( cursor, end, labelSize )
+      || !ReadBytes( cursor, end, labelSize, label )
+      || !ReadBytes( cursor, end, insertedSize, inserted )
+      || !ReadPOD( cursor, end, resultHash )
+      || offset + removedSize > document.size() )
+      break;
+
+    std::string result = document;
+    result.replace(
+      size_t( offset ), size_t( removedSize ),
+      inserted, size_t( insertedSize )
+      );
+    if ( HashBytes( result.data(), result.size() ) != resultHash )
+      break;
+
+    document.swap( result );
+    if ( lastLabel )
+      lastLabel->assign( label, labelSize );
+  }
+
+  return true;
+}
+
+AutosaveWriter::AutosaveWriter(
+  std::string const &filePath,
+  QObject *parent
+  )
+  : QObject( parent )
+  , m_journal( filePath )
+  , m_bindingVersion( 0 )
+{
+  connect(
+    &m_watcher, SIGNAL(finished()),
+    this, SLOT(onWriteFinished())
+    );
+}
+
+AutosaveWriter::~AutosaveWriter()
+{
+  waitForFinished();
+}
+
+bool AutosaveWriter::isBusy() const
+{
+  return m_watcher.isRunning();
+}
+
+bool AutosaveWriter::start(
+  QByteArray const &json,
+  uint32_t bindingVersion,
+  QString const &label
+  )
+{
+  if ( isBusy() )
+    return false;
+
+  m_bindingVersion = bindingVersion;
+  m_watcher.setFuture(
+    QtConcurrent::run(
+      this, &AutosaveWriter::write,
+      json, std::string( label.toUtf8().constData() )
+      )
+    );
+  return true;
+}
+
+void AutosaveWriter::waitForFinished()
+{
+  m_watcher.waitForFinished();
+}
+
+void AutosaveWriter::removeFiles()
+{
+  waitForFinished();
+  m_journal.remove();
+}
+
+void AutosaveWriter::onWriteFinished()
+{
+  emit finished( m_watcher.result(), m_bindingVersion );
+}
+
+bool AutosaveWriter::write( QByteArray json, std::string label )
+{
+  CANVAS_TRACE_SCOPE( "autosaveWrite" );
+
+  return m_journal.write( json.constData(), uint32_t( json.size() ), label );
+}
@@ -0,0 +1,122 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_AUTOSAVE_H__
+#define __CANVAS_AUTOSAVE_H__
+
+#include <FabricCore.h>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QObject>
+
+#include <string>
+
+// Append-only journal of autosaves. A full checkpoint of the document is
+// written next to the journal from time to time; in between, each autosave
+// only appends the byte range that changed since the previous one, so the
+// I/O scales with the size of the edit rather than the size of the scene.
+// Records are written in native byte order.
+class AutosaveJournal
+{
+public:
+
+  AutosaveJournal( std::string const &checkpointFilePath );
+
+  std::string const &checkpointFilePath() const
+    { return m_checkpointFilePath; }
+  std::string const &journalFilePath() const
+    { return m_journalFilePath; }
+
+  // records the document, either as a delta appended to the journal or,
+  // when the journal has grown too large, as a new compacting checkpoint.
+  // the label (typically the undo command text) is kept with the record.
+  bool write(
+    char const *data,
+    uint32_t size,
+    std::string const &label
+    );
+
+  void remove();
+
+  // rebuilds the latest document from a checkpoint and its journal.
+  // records that are truncated or do not match are ignored, along with
+  // everything after them.
+  static bool Replay(
+    std::string const &checkpointFilePath,
+    std::string &document,
+    std::string *lastLabel = 0
+    );
+
+  static std::string JournalFilePath( std::string const &checkpointFilePath );
+
+private:
+
+  bool writeCheckpoint(
+    char const *data,
+    uint32_t size
+    );
+
+  // compact once the journal is this large relative to the document,
+  // or holds this many records
+  static const uint32_t s_maxJournalRatioPercent = 50;
+  static const uint32_t s_maxRecordCount = 256;
+
+  std::string m_checkpointFilePath;
+  std::string m_journalFilePath;
+  std::string m_document;
+  bool m_hasCheckpoint;
+  uint64_t m_journalSize;
+  uint32_t m_recordCount;
+};
+
+// Writes autosaves in the background. The JSON is exported beforehand by
+// the graph executor, on its thread, while the binding is not evaluated;
+// the journal diff, its compression and the write happen on a worker
+// thread, and at most one autosave is in flight at a time.
+class AutosaveWriter : public QObject
+{
+  Q_OBJECT
+
+public:
+
+  AutosaveWriter( std::string const &filePath, QObject *parent = NULL );
+  ~AutosaveWriter();
+
+  std::string const &filePath() const
+    { return m_journal.checkpointFilePath(); }
+
+  bool isBusy() const;
+
+  // returns false, and does nothing, if the previous autosave is
+  // still being written
+  bool start(
+    QByteArray const &json,
+    uint32_t bindingVersion,
+    QString const &label
+    );
+
+  void waitForFinished();
+
+  // deletes the checkpoint and the journal
+  void removeFiles();
+
+signals:
+
+  void finished( bool succeeded, unsigned bindingVersion );
+
+private slots:
+
+  void onWriteFinished();
+
+private:
+
+  bool write( QByteArray json, std::string label );
+
+  AutosaveJournal m_journal;
+  QFutureWatcher<bool> m_watcher;
+  uint32_t m_bindingVersion;
+};
+
+#endif // __CANVAS_AUTOSAVE_H__
@@ -0,0 +1,347 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasBatch.h"
+#include "CanvasFile.h"
+#include "CanvasTimeline.h"
+
+#include <FabricServices/Persistence/RTValToJSONEncoder.hpp>
+#include <FabricServices/Persistence/RTValFromJSONDecoder.hpp>
+
+#include <FTL/CStrRef.h>
+#include <FTL/JSONValue.h>
+#include <FTL/OwnedPtr.h>
+#include <FTL/StrRef.h>
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFuture>
+#include <QtCore/QList>
+#include <QtCore/QThreadPool>
+#include <QtCore/QtConcurrentRun>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(FTL_OS_LINUX)
+# include <unistd.h>
+#endif
+
+// defined in CanvasMainWindow.cpp
+extern FabricServices::Persistence::RTValToJSONEncoder sRTValEncoder;
+extern FabricServices::Persistence::RTValFromJSONDecoder sRTValDecoder;
+
+// resident memory of the process, or 0 where it is not available
+static int64_t GetResidentMemoryKB()
+{
+#if defined(FTL_OS_LINUX)
+  FILE *file = fopen( "/proc/self/statm", "r" );
+  if ( !file )
+    return 0;
+  long pageCount = 0;
+  long residentPageCount = 0;
+  int count = fscanf( file, "%ld %ld", &pageCount, &residentPageCount );
+  fclose( file );
+  if ( count != 2 )
+    return 0;
+  return int64_t( residentPageCount ) * int64_t( sysconf( _SC_PAGESIZE ) ) / 1024;
+#else
+  return 0;
+#endif
+}
+
+void BatchRunner::ReportCallback(
+  void *userdata,
+  FEC_ReportSource source,
+  FEC_ReportLevel level,
+  char const *lineCStr,
+  uint32_t lineSize
+  )
+{
+  FILE *stream = level == FEC_ReportLevel_Error? stderr: stdout;
+  fwrite( lineCStr, 1, lineSize, stream );
+  fputc( '\n', stream );
+}
+
+void BatchRunner::StatusCallback(
+  void *userdata,
+  char const *destinationData, uint32_t destinationLength,
+  char const *payloadData, uint32_t payloadLength
+  )
+{
+  FTL::StrRef destination( destinationData, destinationLength );
+  FTL::StrRef payload( payloadData, payloadLength );
+  if ( destination == FTL_STR( "licensing" ) )
+    printf(
+      "Licensing: %.*s\n",
+      int( payload.size() ), payload.data()
+      );
+}
+
+BatchRunner::BatchRunner( bool unguarded )
+  : m_frameIn( 1 )
+  , m_frameOut( 1 )
+  , m_hasFrameRange( false )
+{
+  FabricCore::Client::CreateOptions options;
+  memset( &options, 0, sizeof( options ) );
+  options.guarded = !unguarded;
+  options.optimizationType = FabricCore::ClientOptimizationType_Background;
+  options.licenseType = FabricCore::ClientLicenseType_Compute;
+  options.rtValToJSONEncoder = &sRTValEncoder;
+  options.rtValFromJSONDecoder = &sRTValDecoder;
+  m_client = FabricCore::Client(
+    &BatchRunner::ReportCallback,
+    this,
+    &options
+    );
+  m_client.setStatusCallback( &BatchRunner::StatusCallback, this );
+
+  m_evalContext = FabricCore::RTVal::Create(m_client, "EvalContext", 0, 0);
+  m_evalContext = m_evalContext.callMethod("EvalContext", "getInstance", 0, 0);
+  m_evalContext.setMember("host", FabricCore::RTVal::ConstructString(m_client, "Canvas"));
+  m_evalContext.setMember("graph", FabricCore::RTVal::ConstructString(m_client, ""));
+  m_evalContextTime = FabricCore::RTVal::ConstructFloat32(m_client, 0.0f);
+
+  m_host = m_client.getDFGHost();
+}
+
+BatchRunner::~BatchRunner()
+{
+}
+
+void BatchRunner::setFrameRange( int frameIn, int frameOut )
+{
+  m_frameIn = frameIn;
+  m_frameOut = frameOut;
+  m_hasFrameRange = true;
+}
+
+bool ConvertCanvasFile(
+  std::string const &inputFilePath,
+  std::string const &outputFilePath
+  )
+{
+  CanvasDocument document;
+  if ( !document.open( inputFilePath.c_str() ) )
+  {
+    printf( "Error: unable to read %s\n", inputFilePath.c_str() );
+    return false;
+  }
+
+  if ( !WriteCanvasDocument(
+    outputFilePath, document.json(), document.jsonSize() ) )
+  {
+    printf( "Error: unable to write %s\n", outputFilePath.c_str() );
+    return false;
+  }
+
+  printf(
+    "Converted %s to %s\n",
+    inputFilePath.c_str(),
+    outputFilePath.c_str()
+    );
+  return true;
+}
+
+bool BatchRunner::run( std::string const &filePath )
+{
+  printf( "Evaluating %s\n", filePath.c_str() );
+
+  CanvasDocument document;
+  if ( !document.open( filePath.c_str() ) )
+  {
+    printf( "Error: unable to read %s\n", filePath.c_str() );
+    return false;
+  }
+
+  try
+  {
+    QElapsedTimer timer;
+    timer.start();
+
+    FabricCore::DFGBinding binding =
+      m_host.createBindingFromJSON( document.json() );
+    document.close();
+    FabricCore::DFGExec exec = binding.getExec();
+
+    m_evalContext.setMember("currentFilePath", FabricCore::RTVal::ConstructString(m_client, filePath.c_str()));
+
+    int frameIn = m_frameIn;
+    int frameOut = m_frameOut;
+    if ( !m_hasFrameRange )
+    {
+      // use the range stored with the graph, as the UI does
+      FTL::CStrRef tl_start = exec.getMetadata("timeline_start");
+      FTL::CStrRef tl_end = exec.getMetadata("timeline_end");
+      if ( !tl_start.empty() && !tl_end.empty() )
+      {
+        frameIn = atoi( tl_start.c_str() );
+        frameOut = atoi( tl_end.c_str() );
+      }
+    }
+
+    RootPortMap ports;
+    TimelinePort timelinePort;
+    timelinePort.resolve( exec, ports );
+    printf(
+      "  loaded in %.3f ms\n",
+      double( timer.nsecsElapsed() ) / 1.0e6
+      );
+
+    double totalMS = 0.0;
+    for ( int frame = frameIn; frame <= frameOut; ++frame )
+    {
+      timer.restart();
+
+      m_evalContextTime.setFloat32( float( frame ) );
+      m_evalContext.setMember("time", m_evalContextTime);
+      timelinePort.setFrame( m_client, binding, frame );
+      binding.execute();
+
+      double frameMS = double( timer.nsecsElapsed() ) / 1.0e6;
+      totalMS += frameMS;
+      printf( "  frame %d: %.3f ms\n", frame, frameMS );
+    }
+
+    int frameCount = frameOut - frameIn + 1;
+    if ( frameCount > 0 )
+      printf(
+        "  %d frames in %.3f ms (%.3f ms/frame)\n",
+        frameCount,
+        totalMS,
+        totalMS / double( frameCount )
+        );
+
+    binding.deallocValues();
+  }
+  catch ( FabricCore::Exception e )
+  {
+    printf( "Error: %s\n", e.getDesc_cstr() );
+    return false;
+  }
+
+  return true;
+}
+
+ValidationReport BatchRunner::validateFile( std::string filePath )
+{
+  ValidationReport report;
+  report.filePath = filePath;
+  report.loaded = false;
+  report.loadMS = 0.0;
+  report.executeMS = 0.0;
+
+  int64_t memoryBeforeKB = GetResidentMemoryKB();
+
+  CanvasDocument document;
+  if ( !document.open( filePath.c_str() ) )
+  {
+    report.errors.push_back( "unable to read the file" );
+    report.memoryDeltaKB = 0;
+    return report;
+  }
+
+  try
+  {
+    QElapsedTimer timer;
+    timer.start();
+
+    FabricCore::DFGBinding binding =
+      m_host.createBindingFromJSON( document.json() );
+    document.close();
+    report.loadMS = double( timer.nsecsElapsed() ) / 1.0e6;
+    report.loaded = true;
+
+    FabricCore::String errorsJSON = binding.getErrors( true );
+    FTL::JSONStrWithLoc errorsJSONStr( errorsJSON.getCStr() );
+    FTL::OwnedPtr<FTL::JSONArray> errorsJSONArray(
+      FTL::JSONArray::Decode( errorsJSONStr )
+      );
+    for ( size_t i = 0; i < errorsJSONArray->size(); ++i )
+    {
+      FTL::JSONObject const *errorJSONObject =
+        errorsJSONArray->getObject( i );
+      std::string error = errorJSONObject->getStringOrEmpty( FTL_STR("execPath") );
+      if ( !error.empty() )
+        error += ": ";
+      error += errorJSONObject->getStringOrEmpty( FTL_STR("desc") );
+      report.errors.push_back( error );
+    }
+
+    if ( report.errors.empty() )
+    {
+      timer.restart();
+      binding.execute();
+      report.executeMS = double( timer.nsecsElapsed() ) / 1.0e6;
+    }
+
+    binding.deallocValues();
+  }
+  catch ( FabricCore::Exception e )
+  {
+    report.errors.push_back( e.getDesc_cstr() );
+  }
+  catch ( FTL::JSONException e )
+  {
+    // an exception must not leave the worker: result() would rethrow it
+    FTL::StrRef desc = e.getDesc();
+    report.errors.push_back(
+      "unable to parse the errors: " + std::string( desc.data(), desc.size() )
+      );
+  }
+
+  report.memoryDeltaKB = GetResidentMemoryKB() - memoryBeforeKB;
+  return report;
+}
+
+int BatchRunner::validate(
+  std::vector<std::string> const &filePaths,
+  int threadCount
+  )
+{
+  if ( threadCount > 0 )
+    QThreadPool::globalInstance()->setMaxThreadCount( threadCount );
+
+  QElapsedTimer timer;
+  timer.start();
+
+  QList< QFuture<ValidationReport> > futures;
+  for ( size_t i = 0; i < filePaths.size(); ++i )
+    futures.append(
+      QtConcurrent::run( this, &BatchRunner::validateFile, filePaths[i] )
+      );
+
+  // reports are printed in the order of the command line
+  int failures = 0;
+  for ( int i = 0; i < futures.size(); ++i )
+  {
+    ValidationReport report = futures[i].result();
+    bool failed = !report.loaded || !report.errors.empty();
+    if ( failed )
+      ++failures;
+
+    printf(
+      "%s %s\n"
+      "  load %.3f ms, compile+execute %.3f ms, memory %+lld KB, %d error(s)\n",
+      failed? "FAIL": "OK  ",
+      report.filePath.c_str(),
+      report.loadMS,
+      report.executeMS,
+      (long long)report.memoryDeltaKB,
+      int( report.errors.size() )
+      );
+    for ( size_t j = 0; j < report.errors.size(); ++j )
+      printf( "  error: %s\n", report.errors[j].c_str() );
+  }
+
+  printf(
+    "Validated %d file(s) in %.3f s on %d thread(s): %d failed\n",
+    int( filePaths.size() ),
+    double( timer.nsecsElapsed() ) / 1.0e9,
+    QThreadPool::globalInstance()->maxThreadCount(),
+    failures
+    );
+  return failures;
+}
@@ -0,0 +1,85 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_BATCH_H__
+#define __CANVAS_BATCH_H__
+
+#include <FabricCore.h>
+#include <string>
+#include <vector>
+
+struct ValidationReport
+{
+  std::string filePath;
+  bool loaded;
+  double loadMS;
+  // the first evaluation, which includes the compilation
+  double executeMS;
+  std::vector<std::string> errors;
+  // change of the process' resident memory while the file was
+  // being validated; approximate when files run in parallel
+  int64_t memoryDeltaKB;
+};
+
+// Evaluates graphs without any widgets: only the client, the DFG host
+// and the eval context are created. Used by the --batch command line mode.
+class BatchRunner
+{
+public:
+
+  BatchRunner( bool unguarded );
+  ~BatchRunner();
+
+  // by default the range stored in the graph's metadata is used
+  void setFrameRange( int frameIn, int frameOut );
+
+  // loads the graph and evaluates every frame of the range,
+  // printing the wall time per frame. returns false on failure.
+  bool run( std::string const &filePath );
+
+  // loads, checks for errors and evaluates once every graph, with one
+  // binding per file spread over threadCount worker threads, then prints
+  // a report per file. returns the number of files that failed.
+  int validate(
+    std::vector<std::string> const &filePaths,
+    int threadCount
+    );
+
+  static void ReportCallback(
+    void *userdata,
+    FEC_ReportSource source,
+    FEC_ReportLevel level,
+    char const *lineCStr,
+    uint32_t lineSize
+    );
+  static void StatusCallback(
+    void *userdata,
+    char const *destinationData,
+    uint32_t destinationLength,
+    char const *payloadData,
+    uint32_t payloadLength
+    );
+
+private:
+
+  ValidationReport validateFile( std::string filePath );
+
+  FabricCore::Client m_client;
+  FabricCore::DFGHost m_host;
+  FabricCore::RTVal m_evalContext;
+  // updated in place for each frame
+  FabricCore::RTVal m_evalContextTime;
+  int m_frameIn;
+  int m_frameOut;
+  bool m_hasFrameRange;
+};
+
+// Converts between the .canvas and .canvasz formats; the input format is
+// detected from its contents, the output format from its extension.
+bool ConvertCanvasFile(
+  std::string const &inputFilePath,
+  std::string const &outputFilePath
+  );
+
+#endif // __CANVAS_BATCH_H__
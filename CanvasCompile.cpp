@@ -0,0 +1,102 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasCompile.h"
+
+CompileScheduler::CompileScheduler(
+  FabricUI::DFG::DFGController *controller,
+  GraphExecutor *executor,
+  unsigned idleMS,
+  QObject *parent
+  )
+  : QObject( parent )
+  , m_controller( controller )
+  , m_executor( executor )
+  , m_enabled( false )
+  , m_manuallyBlocked( false )
+  , m_state( State_Idle )
+  , m_deferredEditCount( 0 )
+{
+  m_idleTimer.setSingleShot( true );
+  m_idleTimer.setInterval( idleMS );
+  connect( &m_idleTimer, SIGNAL(timeout()), this, SLOT(flush()) );
+
+  connect( m_executor, SIGNAL(executed(double, int, unsigned)), this, SLOT(onExecuted()) );
+  connect( m_executor, SIGNAL(executionFailed(QString)), this, SLOT(onExecuted()) );
+}
+
+void CompileScheduler::setState( State state )
+{
+  if ( state != State_Deferred )
+    m_deferredEditCount = 0;
+  m_state = state;
+  emit stateChanged();
+}
+
+void CompileScheduler::setEnabled( bool enabled )
+{
+  m_enabled = enabled;
+  // the edits deferred so far are compiled right away
+  if ( !enabled )
+    flush();
+}
+
+void CompileScheduler::setManuallyBlocked( bool blocked )
+{
+  m_manuallyBlocked = blocked;
+  m_idleTimer.stop();
+
+  // the deferred edits stay deferred until the block is cleared
+  if ( !blocked && m_state == State_Deferred )
+    flush();
+  else
+    m_controller->setBlockCompilations( blocked );
+}
+
+void CompileScheduler::reset()
+{
+  m_idleTimer.stop();
+  if ( m_state == State_Deferred && !m_manuallyBlocked )
+    m_controller->setBlockCompilations( false );
+  if ( m_state != State_Idle )
+    setState( State_Idle );
+}
+
+void CompileScheduler::onEdited()
+{
+  if ( !m_enabled || m_manuallyBlocked )
+    return;
+
+  // the core cannot interrupt the running compilation: the edits that
+  // follow must wait for it, and its result is outdated
+  if ( m_state == State_Compiling )
+  {
+    m_executor->cancel();
+    m_executor->waitForIdle();
+  }
+
+  if ( m_state != State_Deferred )
+    m_controller->setBlockCompilations( true );
+
+  ++m_deferredEditCount;
+  setState( State_Deferred );
+  m_idleTimer.start();
+}
+
+void CompileScheduler::flush()
+{
+  m_idleTimer.stop();
+  if ( m_state != State_Deferred || m_manuallyBlocked )
+    return;
+
+  m_controller->setBlockCompilations( false );
+  setState( State_Compiling );
+  emit compileRequested();
+}
+
+void CompileScheduler::onExecuted()
+{
+  if ( m_state == State_Compiling )
+    setState( State_Idle );
+}
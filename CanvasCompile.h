@@ -0,0 +1,88 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_COMPILE_H__
+#define __CANVAS_COMPILE_H__
+
+#include "CanvasExecutor.h"
+
+#include <FabricUI/DFG/DFGUI.h>
+
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+
+// Defers compilations while structural edits keep arriving. The first
+// edit of a burst blocks the controller's compilations; once no edit
+// has come for the idle interval they are unblocked and an evaluation
+// is requested, which compiles the graph on the executor's thread.
+//
+// The core cannot interrupt a compilation, so the edits must not reach
+// the binding while it runs: the ExecutorInputGate holds the user's input
+// back until the executor is idle, and an edit notified while compiling
+// waits for the compilation to complete, drops its outdated result and
+// starts a new deferral. The manual block of the View menu takes
+// precedence; the edits deferred when it is set are compiled once it is
+// cleared.
+class CompileScheduler : public QObject
+{
+  Q_OBJECT
+
+public:
+
+  enum State
+  {
+    State_Idle,
+    State_Deferred,
+    State_Compiling
+  };
+
+  CompileScheduler(
+    FabricUI::DFG::DFGController *controller,
+    GraphExecutor *executor,
+    unsigned idleMS,
+    QObject *parent = NULL
+    );
+
+  bool isEnabled() const
+    { return m_enabled; }
+  State state() const
+    { return m_state; }
+  unsigned deferredEditCount() const
+    { return m_deferredEditCount; }
+
+  void setManuallyBlocked( bool blocked );
+
+  // unblocks the deferred compilations without requesting an
+  // evaluation, before the binding is replaced
+  void reset();
+
+signals:
+
+  void compileRequested();
+  void stateChanged();
+
+public slots:
+
+  void setEnabled( bool enabled );
+  void onEdited();
+  void flush();
+
+private slots:
+
+  void onExecuted();
+
+private:
+
+  void setState( State state );
+
+  FabricUI::DFG::DFGController *m_controller;
+  GraphExecutor *m_executor;
+  QTimer m_idleTimer;
+  bool m_enabled;
+  bool m_manuallyBlocked;
+  State m_state;
+  unsigned m_deferredEditCount;
+};
+
+#endif // __CANVAS_COMPILE_H__
@@ -0,0 +1,554 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasExecutor.h"
+#include "CanvasTrace.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QEvent>
+#include <QtCore/QMimeData>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QStringList>
+#include <QtGui/QContextMenuEvent>
+#include <QtGui/QDropEvent>
+#include <QtGui/QKeyEvent>
+#include <QtGui/QMouseEvent>
+#include <QtGui/QShortcutEvent>
+#include <QtGui/QWidget>
+
+#include <stdio.h>
+
+GraphExecutorWorker::GraphExecutorWorker( GraphExecutor *executor )
+  : m_executor( executor )
+{
+}
+
+void GraphExecutorWorker::process()
+{
+  for (;;)
+  {
+    FabricCore::DFGBinding binding;
+    bool isExport = false;
+    int frame = 0;
+    unsigned generation = 0;
+    uint32_t serial;
+    {
+      QMutexLocker locker( &m_executor->m_mutex );
+      // the values set meanwhile are applied on the UI thread first
+      if ( ( !m_executor->m_hasPending && !m_executor->m_hasPendingExport )
+        || !m_executor->m_pendingValues.empty() )
+      {
+        m_executor->m_running = false;
+        m_executor->m_idleCondition.wakeAll();
+        // applies the values and lets the held input through
+        QMetaObject::invokeMethod(
+          m_executor, "resume", Qt::QueuedConnection
+          );
+        return;
+      }
+      if ( m_executor->m_hasPendingExport )
+      {
+        binding = m_executor->m_pendingExportBinding;
+        isExport = true;
+        m_executor->m_pendingExportBinding = FabricCore::DFGBinding();
+        m_executor->m_hasPendingExport = false;
+      }
+      else
+      {
+        binding = m_executor->m_pendingBinding;
+        frame = m_executor->m_pendingFrame;
+        generation = m_executor->m_pendingGeneration;
+        m_executor->m_pendingBinding = FabricCore::DFGBinding();
+        m_executor->m_hasPending = false;
+      }
+      serial = m_executor->m_requestSerial;
+    }
+
+    if ( isExport )
+    {
+      exportBinding( binding, serial );
+      continue;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QString errorMessage;
+    try
+    {
+      CANVAS_TRACE_SCOPE( "execute" );
+      binding.execute();
+    }
+    catch ( FabricCore::Exception e )
+    {
+      errorMessage = e.getDesc_cstr();
+    }
+
+    double elapsedMS = double( timer.nsecsElapsed() ) / 1.0e6;
+
+    {
+      QMutexLocker locker( &m_executor->m_mutex );
+      // a newer request is already queued: skip straight to it
+      if ( m_executor->m_hasPending
+        || serial <= m_executor->m_cancelledSerial )
+        continue;
+
+      // the next evaluation waits until the outputs have been read
+      m_executor->m_awaitingRelease = true;
+      m_executor->m_running = false;
+      m_executor->m_idleCondition.wakeAll();
+    }
+
+    if ( !errorMessage.isEmpty() )
+      emit m_executor->executionFailed( errorMessage );
+    else
+      emit m_executor->executed( elapsedMS, frame, generation );
+    return;
+  }
+}
+
+void GraphExecutorWorker::exportBinding(
+  FabricCore::DFGBinding &binding,
+  uint32_t serial
+  )
+{
+  QByteArray json;
+  uint32_t bindingVersion = 0;
+  try
+  {
+    CANVAS_TRACE_SCOPE( "autosaveExport" );
+    bindingVersion = binding.getVersion();
+    FabricCore::DFGStringResult jsonResult = binding.exportJSON();
+    char const *jsonData;
+    uint32_t jsonSize;
+    jsonResult.getStringDataAndLength( jsonData, jsonSize );
+    json = QByteArray( jsonData, int( jsonSize ) );
+  }
+  catch ( FabricCore::Exception e )
+  {
+    printf("Exception: %s\n", e.getDesc_cstr());
+  }
+
+  {
+    QMutexLocker locker( &m_executor->m_mutex );
+    if ( serial <= m_executor->m_cancelledSerial )
+      return;
+    m_executor->m_exportedJSON = json;
+    m_executor->m_exportedBindingVersion = bindingVersion;
+    m_executor->m_hasExported = true;
+  }
+  QMetaObject::invokeMethod(
+    m_executor, "deliverExport", Qt::QueuedConnection
+    );
+}
+
+GraphExecutor::GraphExecutor( QObject *parent )
+  : QObject( parent )
+  , m_pendingFrame( 0 )
+  , m_pendingGeneration( 0 )
+  , m_hasPending( false )
+  , m_hasPendingExport( false )
+  , m_exportedBindingVersion( 0 )
+  , m_hasExported( false )
+  , m_running( false )
+  , m_awaitingRelease( false )
+  , m_requestSerial( 0 )
+  , m_cancelledSerial( 0 )
+{
+  m_worker = new GraphExecutorWorker( this );
+  m_worker->moveToThread( &m_thread );
+  m_thread.start();
+}
+
+GraphExecutor::~GraphExecutor()
+{
+  cancel();
+  waitForIdle();
+  m_thread.quit();
+  m_thread.wait();
+  delete m_worker;
+}
+
+void GraphExecutor::startWorker()
+{
+  m_running = true;
+  QMetaObject::invokeMethod( m_worker, "process", Qt::QueuedConnection );
+}
+
+void GraphExecutor::requestExecute(
+  FabricCore::DFGBinding const &binding,
+  int frame,
+  unsigned generation
+  )
+{
+  QMutexLocker locker( &m_mutex );
+  m_pendingBinding = binding;
+  m_pendingFrame = frame;
+  m_pendingGeneration = generation;
+  m_hasPending = true;
+  ++m_requestSerial;
+  if ( !m_running && !m_awaitingRelease )
+    startWorker();
+}
+
+void GraphExecutor::requestExport( FabricCore::DFGBinding const &binding )
+{
+  QMutexLocker locker( &m_mutex );
+  m_pendingExportBinding = binding;
+  m_hasPendingExport = true;
+  ++m_requestSerial;
+  if ( !m_running && !m_awaitingRelease )
+    startWorker();
+}
+
+void GraphExecutor::Apply( PendingValue &pendingValue )
+{
+  if ( pendingValue.object.isValid() )
+    pendingValue.object.setMember(
+      pendingValue.name.c_str(), pendingValue.value
+      );
+  else if ( pendingValue.name.empty() )
+    pendingValue.binding.setArgValue(
+      pendingValue.index, pendingValue.value, false
+      );
+  else
+    pendingValue.binding.setArgValue(
+      pendingValue.name.c_str(), pendingValue.value, false
+      );
+}
+
+void GraphExecutor::setValue( PendingValue const &pendingValue )
+{
+  {
+    QMutexLocker locker( &m_mutex );
+    if ( m_running )
+    {
+      m_pendingValues.push_back( pendingValue );
+      return;
+    }
+  }
+  // only the UI thread starts evaluations, so none can start meanwhile
+  PendingValue value = pendingValue;
+  Apply( value );
+}
+
+void GraphExecutor::setArgValue(
+  FabricCore::DFGBinding const &binding,
+  unsigned index,
+  FabricCore::RTVal const &value
+  )
+{
+  PendingValue pendingValue;
+  pendingValue.binding = binding;
+  pendingValue.index = index;
+  pendingValue.value = value;
+  setValue( pendingValue );
+}
+
+void GraphExecutor::setArgValue(
+  FabricCore::DFGBinding const &binding,
+  char const *name,
+  FabricCore::RTVal const &value
+  )
+{
+  PendingValue pendingValue;
+  pendingValue.binding = binding;
+  pendingValue.index = 0;
+  pendingValue.name = name;
+  pendingValue.value = value;
+  setValue( pendingValue );
+}
+
+void GraphExecutor::setMember(
+  FabricCore::RTVal const &object,
+  char const *name,
+  FabricCore::RTVal const &value
+  )
+{
+  PendingValue pendingValue;
+  pendingValue.object = object;
+  pendingValue.index = 0;
+  pendingValue.name = name;
+  pendingValue.value = value;
+  setValue( pendingValue );
+}
+
+void GraphExecutor::release()
+{
+  {
+    QMutexLocker locker( &m_mutex );
+    if ( !m_awaitingRelease )
+      return;
+    m_awaitingRelease = false;
+  }
+  resume();
+}
+
+void GraphExecutor::resume()
+{
+  std::vector<PendingValue> pendingValues;
+  {
+    QMutexLocker locker( &m_mutex );
+    if ( m_running || m_awaitingRelease )
+      return;
+    pendingValues.swap( m_pendingValues );
+  }
+
+  for ( size_t i = 0; i < pendingValues.size(); ++i )
+  {
+    try
+    {
+      Apply( pendingValues[i] );
+    }
+    catch ( FabricCore::Exception e )
+    {
+      emit executionFailed( e.getDesc_cstr() );
+    }
+  }
+
+  {
+    QMutexLocker locker( &m_mutex );
+    if ( m_running || m_awaitingRelease )
+      return;
+  }
+  emit idle();
+
+  QMutexLocker locker( &m_mutex );
+  if ( ( m_hasPending || m_hasPendingExport )
+    && !m_running && !m_awaitingRelease )
+    startWorker();
+}
+
+void GraphExecutor::deliverExport()
+{
+  QByteArray json;
+  uint32_t bindingVersion;
+  {
+    QMutexLocker locker( &m_mutex );
+    if ( !m_hasExported )
+      return;
+    json = m_exportedJSON;
+    bindingVersion = m_exportedBindingVersion;
+    m_exportedJSON = QByteArray();
+    m_hasExported = false;
+  }
+  emit exported( json, bindingVersion );
+}
+
+void GraphExecutor::cancel()
+{
+  QMutexLocker locker( &m_mutex );
+  m_pendingBinding = FabricCore::DFGBinding();
+  m_hasPending = false;
+  m_pendingExportBinding = FabricCore::DFGBinding();
+  m_hasPendingExport = false;
+  m_exportedJSON = QByteArray();
+  m_hasExported = false;
+  m_awaitingRelease = false;
+  m_pendingValues.clear();
+  m_cancelledSerial = m_requestSerial;
+  QMetaObject::invokeMethod( this, "resume", Qt::QueuedConnection );
+}
+
+void GraphExecutor::waitForIdle()
+{
+  QMutexLocker locker( &m_mutex );
+  while ( m_running )
+    m_idleCondition.wait( &m_mutex );
+}
+
+bool GraphExecutor::isBusy() const
+{
+  QMutexLocker locker( &m_mutex );
+  return m_running;
+}
+
+ExecutorInputGate::ExecutorInputGate(
+  GraphExecutor *executor,
+  QObject *parent
+  )
+  : QObject( parent )
+  , m_executor( executor )
+  , m_replayDepth( 0 )
+{
+  QObject::connect(
+    m_executor, SIGNAL(idle()),
+    this, SLOT(flush())
+    );
+}
+
+ExecutorInputGate::~ExecutorInputGate()
+{
+  for ( size_t i = 0; i < m_heldEvents.size(); ++i )
+  {
+    delete m_heldEvents[i].event;
+    delete m_heldEvents[i].mimeData;
+  }
+}
+
+void ExecutorInputGate::exempt( QWidget *widget )
+{
+  m_exemptWidgets.push_back( widget );
+}
+
+void ExecutorInputGate::guardPaint( QWidget *widget )
+{
+  m_paintGuardedWidgets.push_back( widget );
+}
+
+bool ExecutorInputGate::isExempt( QObject *object ) const
+{
+  QWidget *widget = qobject_cast<QWidget *>( object );
+  for ( size_t i = 0; widget && i < m_exemptWidgets.size(); ++i )
+  {
+    if ( m_exemptWidgets[i] == widget
+      || m_exemptWidgets[i]->isAncestorOf( widget ) )
+      return true;
+  }
+  return false;
+}
+
+QEvent *ExecutorInputGate::Copy( QEvent *event, QMimeData *&mimeData )
+{
+  mimeData = NULL;
+  switch ( event->type() )
+  {
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseButtonRelease:
+    case QEvent::MouseButtonDblClick:
+    case QEvent::MouseMove:
+    {
+      QMouseEvent *mouseEvent = static_cast<QMouseEvent *>( event );
+      // hovering does not edit anything
+      if ( event->type() == QEvent::MouseMove
+        && mouseEvent->buttons() == Qt::NoButton )
+        return NULL;
+      return new QMouseEvent(
+        event->type(),
+        mouseEvent->pos(),
+        mouseEvent->globalPos(),
+        mouseEvent->button(),
+        mouseEvent->buttons(),
+        mouseEvent->modifiers()
+        );
+    }
+    case QEvent::KeyPress:
+    case QEvent::KeyRelease:
+    {
+      QKeyEvent *keyEvent = static_cast<QKeyEvent *>( event );
+      return new QKeyEvent(
+        event->type(),
+        keyEvent->key(),
+        keyEvent->modifiers(),
+        keyEvent->text(),
+        keyEvent->isAutoRepeat(),
+        keyEvent->count()
+        );
+    }
+    case QEvent::Shortcut:
+    {
+      QShortcutEvent *shortcutEvent = static_cast<QShortcutEvent *>( event );
+      return new QShortcutEvent(
+        shortcutEvent->key(),
+        shortcutEvent->shortcutId(),
+        shortcutEvent->isAmbiguous()
+        );
+    }
+    case QEvent::ContextMenu:
+    {
+      QContextMenuEvent *menuEvent = static_cast<QContextMenuEvent *>( event );
+      return new QContextMenuEvent(
+        menuEvent->reason(),
+        menuEvent->pos(),
+        menuEvent->globalPos(),
+        menuEvent->modifiers()
+        );
+    }
+    case QEvent::Drop:
+    {
+      QDropEvent *dropEvent = static_cast<QDropEvent *>( event );
+      QMimeData const *sourceData = dropEvent->mimeData();
+      mimeData = new QMimeData;
+      QStringList formats = sourceData->formats();
+      for ( int i = 0; i < formats.size(); ++i )
+        mimeData->setData( formats[i], sourceData->data( formats[i] ) );
+      QDropEvent *copy = new QDropEvent(
+        dropEvent->pos(),
+        dropEvent->possibleActions(),
+        mimeData,
+        dropEvent->mouseButtons(),
+        dropEvent->keyboardModifiers()
+        );
+      copy->setDropAction( dropEvent->dropAction() );
+      // the drag ends now, the drop is delivered later
+      dropEvent->acceptProposedAction();
+      return copy;
+    }
+    default:
+      return NULL;
+  }
+}
+
+bool ExecutorInputGate::eventFilter( QObject *object, QEvent *event )
+{
+  if ( event->type() == QEvent::Paint )
+  {
+    if ( !m_executor->isBusy() )
+      return QObject::eventFilter( object, event );
+    for ( size_t i = 0; i < m_paintGuardedWidgets.size(); ++i )
+    {
+      if ( m_paintGuardedWidgets[i] == object )
+      {
+        // the last completed frame stays on screen until the next one
+        m_skippedPaintWidgets.push_back( m_paintGuardedWidgets[i] );
+        return true;
+      }
+    }
+    return QObject::eventFilter( object, event );
+  }
+
+  // once an event is held, the following ones wait behind it
+  bool hold = m_executor->isBusy()
+    || ( !m_heldEvents.empty() && m_replayDepth == 0 );
+  if ( !hold || isExempt( object ) )
+    return QObject::eventFilter( object, event );
+
+  HeldEvent heldEvent;
+  heldEvent.event = Copy( event, heldEvent.mimeData );
+  if ( !heldEvent.event )
+    return QObject::eventFilter( object, event );
+  heldEvent.target = object;
+  m_heldEvents.push_back( heldEvent );
+  return true;
+}
+
+void ExecutorInputGate::flush()
+{
+  while ( !m_heldEvents.empty() && !m_executor->isBusy() )
+  {
+    // replaying can run a nested event loop that flushes again
+    HeldEvent heldEvent = m_heldEvents.front();
+    m_heldEvents.erase( m_heldEvents.begin() );
+    if ( heldEvent.target )
+    {
+      CANVAS_TRACE_SCOPE( "replayInput" );
+      ++m_replayDepth;
+      QCoreApplication::sendEvent( heldEvent.target, heldEvent.event );
+      --m_replayDepth;
+    }
+    delete heldEvent.event;
+    delete heldEvent.mimeData;
+  }
+
+  if ( m_executor->isBusy() )
+    return;
+  std::vector< QPointer<QWidget> > skippedPaintWidgets;
+  skippedPaintWidgets.swap( m_skippedPaintWidgets );
+  for ( size_t i = 0; i < skippedPaintWidgets.size(); ++i )
+  {
+    if ( skippedPaintWidgets[i] )
+      skippedPaintWidgets[i]->update();
+  }
+}
@@ -0,0 +1,224 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_EXECUTOR_H__
+#define __CANVAS_EXECUTOR_H__
+
+#include <FabricCore.h>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QPointer>
+#include <QtCore/QString>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+#include <string>
+#include <vector>
+
+class GraphExecutor;
+class QMimeData;
+class QWidget;
+
+// Lives on the executor's thread and runs the evaluations and the exports.
+class GraphExecutorWorker : public QObject
+{
+  Q_OBJECT
+
+public:
+
+  GraphExecutorWorker( GraphExecutor *executor );
+
+public slots:
+
+  void process();
+
+private:
+
+  void exportBinding( FabricCore::DFGBinding &binding, uint32_t serial );
+
+  GraphExecutor *m_executor;
+};
+
+// Evaluates a binding on a worker thread. Requests made while an evaluation
+// is running are merged into a single pending one, so at most one evaluation
+// runs at a time and at most one is queued behind it. The result of an
+// evaluation that was superseded by a newer request is dropped, and the
+// signals are delivered on the thread that owns the executor (the UI thread).
+//
+// The binding is only touched by one thread at a time: the values set
+// while an evaluation runs are queued and applied on the UI thread before
+// the next one starts, and after executed() or executionFailed() no
+// evaluation starts until release() says that the outputs have been read.
+// The binding is exported on the worker too, for the autosave, and the
+// edits wait for the export the same way. idle() is emitted on the UI
+// thread each time the worker has stopped and the outputs have been
+// released, before a queued evaluation starts, so that the edits held
+// back meanwhile can be applied.
+class GraphExecutor : public QObject
+{
+  Q_OBJECT
+
+  friend class GraphExecutorWorker;
+
+public:
+
+  GraphExecutor( QObject *parent = NULL );
+  ~GraphExecutor();
+
+  // the frame and the edit generation identify the inputs the
+  // evaluation sees; they are passed back with executed()
+  void requestExecute(
+    FabricCore::DFGBinding const &binding,
+    int frame = 0,
+    unsigned generation = 0
+    );
+
+  // sets an argument without an undo record: right away when no
+  // evaluation is running, otherwise before the next one starts
+  void setArgValue(
+    FabricCore::DFGBinding const &binding,
+    unsigned index,
+    FabricCore::RTVal const &value
+    );
+  void setArgValue(
+    FabricCore::DFGBinding const &binding,
+    char const *name,
+    FabricCore::RTVal const &value
+    );
+  // likewise for a member of an object the evaluation reads, such as the
+  // evaluation context
+  void setMember(
+    FabricCore::RTVal const &object,
+    char const *name,
+    FabricCore::RTVal const &value
+    );
+
+  // exports the binding as JSON on the worker, before the pending
+  // evaluation; the result comes with exported()
+  void requestExport( FabricCore::DFGBinding const &binding );
+
+  // to be called once the outputs of the last evaluation have been read
+  void release();
+
+  // drops the pending requests and the results of the running one
+  void cancel();
+
+  // blocks until the running evaluation, if any, has completed.
+  // must be called before the binding is deallocated or replaced.
+  void waitForIdle();
+
+  bool isBusy() const;
+
+signals:
+
+  // emitted once the latest requested evaluation has completed
+  void executed( double elapsedMS, int frame, unsigned generation );
+  void executionFailed( QString message );
+  // the JSON is empty if the export failed
+  void exported( QByteArray json, unsigned bindingVersion );
+  void idle();
+
+private slots:
+
+  // applies the queued argument values, then starts the pending request
+  void resume();
+  // emits exported() unless the export has been cancelled meanwhile
+  void deliverExport();
+
+private:
+
+  // an argument of the binding, or a member of the object if it is set
+  struct PendingValue
+  {
+    FabricCore::DFGBinding binding;
+    FabricCore::RTVal object;
+    // used when the name is empty
+    unsigned index;
+    std::string name;
+    FabricCore::RTVal value;
+  };
+
+  static void Apply( PendingValue &pendingValue );
+  // applies the value, or queues it while an evaluation runs
+  void setValue( PendingValue const &pendingValue );
+
+  // m_mutex must be held
+  void startWorker();
+
+  QThread m_thread;
+  GraphExecutorWorker *m_worker;
+
+  mutable QMutex m_mutex;
+  QWaitCondition m_idleCondition;
+  FabricCore::DFGBinding m_pendingBinding;
+  int m_pendingFrame;
+  unsigned m_pendingGeneration;
+  bool m_hasPending;
+  FabricCore::DFGBinding m_pendingExportBinding;
+  bool m_hasPendingExport;
+  QByteArray m_exportedJSON;
+  uint32_t m_exportedBindingVersion;
+  bool m_hasExported;
+  bool m_running;
+  // the outputs of the last evaluation are being read
+  bool m_awaitingRelease;
+  std::vector<PendingValue> m_pendingValues;
+  uint32_t m_requestSerial;
+  uint32_t m_cancelledSerial;
+};
+
+// Application event filter that holds user input back while the executor
+// is busy, and replays it once it is idle, so that the commands issued by
+// the graph view, the value editor and the menus never reach the binding
+// while it is evaluated, without blocking the UI thread meanwhile. Once an
+// event is held, the following input is held too, to keep the order. The
+// widgets whose input only sets argument values through the executor (the
+// viewport, the timeline) are exempt. The widgets that draw the outputs
+// skip their paint events while the binding is evaluated, keeping the last
+// completed frame on screen, and are repainted once it is idle.
+class ExecutorInputGate : public QObject
+{
+  Q_OBJECT
+
+public:
+
+  ExecutorInputGate( GraphExecutor *executor, QObject *parent = NULL );
+  ~ExecutorInputGate();
+
+  void exempt( QWidget *widget );
+  void guardPaint( QWidget *widget );
+
+  virtual bool eventFilter( QObject *object, QEvent *event );
+
+private slots:
+
+  void flush();
+
+private:
+
+  struct HeldEvent
+  {
+    QPointer<QObject> target;
+    QEvent *event;
+    // the data of a drop, which the drag deletes once it is over
+    QMimeData *mimeData;
+  };
+
+  // returns NULL for the events that are not held
+  static QEvent *Copy( QEvent *event, QMimeData *&mimeData );
+
+  bool isExempt( QObject *object ) const;
+
+  GraphExecutor *m_executor;
+  std::vector<QWidget *> m_exemptWidgets;
+  std::vector<QWidget *> m_paintGuardedWidgets;
+  std::vector<HeldEvent> m_heldEvents;
+  std::vector< QPointer<QWidget> > m_skippedPaintWidgets;
+  // the held events being replayed pass while the executor is idle
+  int m_replayDepth;
+};
+
+#endif // __CANVAS_EXECUTOR_H__
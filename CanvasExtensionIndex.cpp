@@ -0,0 +1,326 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasExtensionIndex.h"
+#include "CanvasTrace.h"
+
+#include <FTL/Config.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QEvent>
+#include <QtCore/QFileInfo>
+#include <QtCore/QStringList>
+#include <QtCore/QtConcurrentRun>
+
+#include <algorithm>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+ExtensionIndexEntry::ExtensionIndexEntry()
+  : modifiedMS( 0 )
+  , parseMS( 0.0 )
+  , failed( false )
+  , skipped( false )
+{
+}
+
+static bool CompareParseTime(
+  ExtensionIndexEntry const &lhs,
+  ExtensionIndexEntry const &rhs
+  )
+{
+  // the extensions never parsed have no estimate, and come last
+  if ( ( lhs.parseMS <= 0.0 ) != ( rhs.parseMS <= 0.0 ) )
+    return rhs.parseMS <= 0.0;
+  return lhs.parseMS < rhs.parseMS;
+}
+
+ExtensionIndexer::ExtensionIndexer(
+  ASTWrapper::KLASTManager *manager,
+  std::string const &indexFilePath,
+  unsigned tickIntervalMS,
+  unsigned sliceMS,
+  unsigned idleMS,
+  QObject *parent
+  )
+  : QObject( parent )
+  , m_manager( manager )
+  , m_indexFilePath( indexFilePath )
+  , m_sliceMS( sliceMS )
+  , m_idleMS( idleMS )
+  , m_nextEntry( 0 )
+  , m_parsedCount( 0 )
+  , m_failedCount( 0 )
+{
+  connect(
+    &m_scanWatcher, SIGNAL(finished()),
+    this, SLOT(onScanFinished())
+    );
+  m_tickTimer.setInterval( tickIntervalMS );
+  connect( &m_tickTimer, SIGNAL(timeout()), this, SLOT(parseNextExtension()) );
+}
+
+ExtensionIndexer::~ExtensionIndexer()
+{
+  stop();
+}
+
+void ExtensionIndexer::start()
+{
+  if ( isIndexing() )
+    return;
+
+  m_scanWatcher.setFuture(
+    QtConcurrent::run( &ExtensionIndexer::Scan, m_indexFilePath )
+    );
+}
+
+void ExtensionIndexer::stop()
+{
+  m_scanWatcher.waitForFinished();
+  m_tickTimer.stop();
+  QCoreApplication::instance()->removeEventFilter( this );
+  m_entries.clear();
+  m_nextEntry = 0;
+}
+
+bool ExtensionIndexer::eventFilter( QObject *object, QEvent *event )
+{
+  switch ( event->type() )
+  {
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseMove:
+    case QEvent::Wheel:
+    case QEvent::KeyPress:
+      m_inputTimer.start();
+      break;
+    default:
+      break;
+  }
+  return QObject::eventFilter( object, event );
+}
+
+std::vector<ExtensionIndexEntry> ExtensionIndexer::ReadIndex(
+  std::string const &indexFilePath
+  )
+{
+  std::vector<ExtensionIndexEntry> entries;
+
+  FILE *file = fopen( indexFilePath.c_str(), "r" );
+  if ( !file )
+    return entries;
+
+  // one extension per line: <modifiedMS> <parseMS> <failed> <manifest path>
+  char line[4096];
+  while ( fgets( line, sizeof( line ), file ) )
+  {
+    long long modifiedMS;
+    double parseMS;
+    int failed;
+    int pathOffset;
+    if ( sscanf(
+      line, "%lld %lf %d %n", &modifiedMS, &parseMS, &failed, &pathOffset ) < 3 )
+      continue;
+
+    ExtensionIndexEntry entry;
+    entry.manifestPath = line + pathOffset;
+    while ( !entry.manifestPath.empty()
+      && ( entry.manifestPath[entry.manifestPath.size() - 1] == '\n'
+        || entry.manifestPath[entry.manifestPath.size() - 1] == '\r' ) )
+      entry.manifestPath.resize( entry.manifestPath.size() - 1 );
+    if ( entry.manifestPath.empty() )
+      continue;
+    entry.modifiedMS = modifiedMS;
+    entry.parseMS = parseMS;
+    entry.failed = failed != 0;
+    entries.push_back( entry );
+  }
+
+  fclose( file );
+  return entries;
+}
+
+bool ExtensionIndexer::WriteIndex(
+  std::string const &indexFilePath,
+  std::vector<ExtensionIndexEntry> const &entries
+  )
+{
+  FILE *file = fopen( indexFilePath.c_str(), "w" );
+  if ( !file )
+    return false;
+
+  for ( size_t i = 0; i < entries.size(); ++i )
+  {
+    ExtensionIndexEntry const &entry = entries[i];
+    fprintf(
+      file,
+      "%lld %.3f %d %s\n",
+      (long long)entry.modifiedMS,
+      entry.parseMS,
+      entry.failed? 1: 0,
+      entry.manifestPath.c_str()
+      );
+  }
+
+  bool succeeded = ferror( file ) == 0;
+  if ( fclose( file ) != 0 )
+    succeeded = false;
+  return succeeded;
+}
+
+static int64_t ExtensionModifiedMS( QFileInfo const &manifestInfo )
+{
+  int64_t modifiedMS = manifestInfo.lastModified().toMSecsSinceEpoch();
+
+  QStringList klFilter;
+  klFilter << "*.kl";
+  QDirIterator it(
+    manifestInfo.absolutePath(),
+    klFilter,
+    QDir::Files,
+    QDirIterator::Subdirectories
+    );
+  while ( it.hasNext() )
+  {
+    it.next();
+    int64_t klModifiedMS = it.fileInfo().lastModified().toMSecsSinceEpoch();
+    if ( klModifiedMS > modifiedMS )
+      modifiedMS = klModifiedMS;
+  }
+
+  return modifiedMS;
+}
+
+std::vector<ExtensionIndexEntry> ExtensionIndexer::Scan(
+  std::string indexFilePath
+  )
+{
+  CANVAS_TRACE_SCOPE( "extensionScan" );
+
+  std::map<std::string, ExtensionIndexEntry> previousEntries;
+  std::vector<ExtensionIndexEntry> indexEntries = ReadIndex( indexFilePath );
+  for ( size_t i = 0; i < indexEntries.size(); ++i )
+    previousEntries[indexEntries[i].manifestPath] = indexEntries[i];
+
+  std::vector<ExtensionIndexEntry> entries;
+
+  char const *extsPath = getenv( "FABRIC_EXTS_PATH" );
+  if ( !extsPath )
+    return entries;
+
+#if defined(FTL_PLATFORM_WINDOWS)
+  QChar const separator = ';';
+#else
+  QChar const separator = ':';
+#endif
+  QStringList searchDirs =
+    QString::fromUtf8( extsPath ).split( separator, QString::SkipEmptyParts );
+
+  QStringList manifestFilter;
+  manifestFilter << "*.fpm.json";
+
+  for ( int i = 0; i < searchDirs.size(); ++i )
+  {
+    QDirIterator it(
+      searchDirs[i],
+      manifestFilter,
+      QDir::Files,
+      QDirIterator::Subdirectories
+      );
+    while ( it.hasNext() )
+    {
+      it.next();
+      QFileInfo manifestInfo = it.fileInfo();
+
+      ExtensionIndexEntry entry;
+      entry.manifestPath =
+        manifestInfo.absoluteFilePath().toUtf8().constData();
+      entry.modifiedMS = ExtensionModifiedMS( manifestInfo );
+
+      std::map<std::string, ExtensionIndexEntry>::const_iterator previous =
+        previousEntries.find( entry.manifestPath );
+      if ( previous != previousEntries.end() )
+      {
+        entry.parseMS = previous->second.parseMS;
+        if ( previous->second.modifiedMS == entry.modifiedMS )
+        {
+          entry.failed = previous->second.failed;
+          entry.skipped = entry.failed;
+        }
+      }
+
+      entries.push_back( entry );
+    }
+  }
+
+  // the cheapest extensions first, so that most of the symbols are
+  // available early
+  std::stable_sort( entries.begin(), entries.end(), CompareParseTime );
+  return entries;
+}
+
+void ExtensionIndexer::onScanFinished()
+{
+  m_entries = m_scanWatcher.result();
+  m_nextEntry = 0;
+  m_parsedCount = 0;
+  m_failedCount = 0;
+  m_inputTimer.start();
+  QCoreApplication::instance()->installEventFilter( this );
+  m_tickTimer.start();
+}
+
+void ExtensionIndexer::parseNextExtension()
+{
+  while ( m_nextEntry < m_entries.size() && m_entries[m_nextEntry].skipped )
+  {
+    ++m_failedCount;
+    ++m_nextEntry;
+  }
+
+  if ( m_nextEntry == m_entries.size() )
+  {
+    m_tickTimer.stop();
+    QCoreApplication::instance()->removeEventFilter( this );
+    if ( !WriteIndex( m_indexFilePath, m_entries ) )
+      printf("Error: unable to write %s\n", m_indexFilePath.c_str());
+    emit finished( m_parsedCount, m_failedCount );
+    return;
+  }
+
+  // a parse that would not fit in the slice waits for the user to
+  // pause, rather than stalling the input
+  double estimatedMS = m_entries[m_nextEntry].parseMS;
+  if ( ( estimatedMS <= 0.0 || estimatedMS > m_sliceMS )
+    && m_inputTimer.elapsed() < m_idleMS )
+    return;
+
+  CANVAS_TRACE_SCOPE( "parseExtension" );
+
+  ExtensionIndexEntry &entry = m_entries[m_nextEntry++];
+
+  QElapsedTimer parseTimer;
+  parseTimer.start();
+
+  entry.failed = true;
+  try
+  {
+    entry.failed = !m_manager->loadExtension( entry.manifestPath.c_str() );
+  }
+  catch ( FabricCore::Exception e )
+  {
+    printf("Exception: %s\n", e.getDesc_cstr());
+  }
+
+  entry.parseMS = double( parseTimer.nsecsElapsed() ) / 1.0e6;
+  if ( entry.failed )
+    ++m_failedCount;
+  else
+    ++m_parsedCount;
+}
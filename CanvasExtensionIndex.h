@@ -0,0 +1,105 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_EXTENSION_INDEX_H__
+#define __CANVAS_EXTENSION_INDEX_H__
+
+#include <ASTWrapper/KLASTManager.h>
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// One extension found on FABRIC_EXTS_PATH, as recorded in the index file.
+// The file lists the extensions and what parsing them cost; it holds no
+// symbols, which only the KLASTManager has once it parsed them.
+struct ExtensionIndexEntry
+{
+  std::string manifestPath;
+  // newest modification time of the manifest and its KL files
+  int64_t modifiedMS;
+  // time the last parse took, used to parse the cheap extensions first
+  double parseMS;
+  bool failed;
+  // unchanged since a parse that failed; not parsed again
+  bool skipped;
+
+  ExtensionIndexEntry();
+};
+
+// Feeds the extensions of FABRIC_EXTS_PATH to the KLASTManager after
+// startup, so that the KL editor gets their symbols without the cost of
+// loadAllExtensionsFromExtsPath() up front. The search path is walked on
+// a worker thread; the manager is not thread-safe, so the extensions are
+// parsed on the UI thread, one per timer tick. The manager only parses
+// whole extensions: one whose last parse took longer than the slice, or
+// that was never parsed, waits until there has been no user input for a
+// while. The index file remembers each extension's modification time,
+// parse time and outcome between sessions.
+class ExtensionIndexer : public QObject
+{
+  Q_OBJECT
+
+public:
+
+  ExtensionIndexer(
+    ASTWrapper::KLASTManager *manager,
+    std::string const &indexFilePath,
+    unsigned tickIntervalMS,
+    unsigned sliceMS,
+    unsigned idleMS,
+    QObject *parent = NULL
+    );
+  ~ExtensionIndexer();
+
+  void start();
+  // waits for the walk in flight and stops feeding the manager
+  void stop();
+
+  bool isIndexing() const
+    { return m_scanWatcher.isRunning() || m_tickTimer.isActive(); }
+
+  static std::vector<ExtensionIndexEntry> ReadIndex(
+    std::string const &indexFilePath
+    );
+  static bool WriteIndex(
+    std::string const &indexFilePath,
+    std::vector<ExtensionIndexEntry> const &entries
+    );
+
+  // notes the user input that keeps the long parses waiting
+  virtual bool eventFilter( QObject *object, QEvent *event );
+
+signals:
+
+  void finished( unsigned parsedCount, unsigned failedCount );
+
+private slots:
+
+  void onScanFinished();
+  void parseNextExtension();
+
+private:
+
+  static std::vector<ExtensionIndexEntry> Scan( std::string indexFilePath );
+
+  ASTWrapper::KLASTManager *m_manager;
+  std::string m_indexFilePath;
+  QFutureWatcher< std::vector<ExtensionIndexEntry> > m_scanWatcher;
+  QTimer m_tickTimer;
+  double m_sliceMS;
+  qint64 m_idleMS;
+  QElapsedTimer m_inputTimer;
+  std::vector<ExtensionIndexEntry> m_entries;
+  size_t m_nextEntry;
+  unsigned m_parsedCount;
+  unsigned m_failedCount;
+};
+
+#endif // __CANVAS_EXTENSION_INDEX_H__
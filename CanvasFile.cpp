@@ -0,0 +1,828 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasFile.h"
+
+#include <FTL/FS.h>
+
+#include <QtCore/QByteArray>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#if defined(FTL_PLATFORM_POSIX)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+static char sEmptyData[1] = { '\0' };
+
+MappedFile::MappedFile()
+  : m_data( NULL )
+  , m_size( 0 )
+  , m_mappedSize( 0 )
+  , m_isMapped( false )
+{
+}
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+#if defined(FTL_PLATFORM_POSIX)
+
+bool MappedFile::open( char const *filePath )
+{
+  close();
+
+  int fd = ::open( filePath, O_RDONLY );
+  if ( fd == -1 )
+    return false;
+
+  struct stat st;
+  if ( ::fstat( fd, &st ) != 0 )
+  {
+    ::close( fd );
+    return false;
+  }
+
+  uint64_t fileSize = uint64_t( st.st_size );
+  if ( fileSize == 0 )
+  {
+    ::close( fd );
+    m_data = sEmptyData;
+    m_size = 0;
+    return true;
+  }
+  if ( fileSize >= uint64_t( size_t( -1 ) ) )
+  {
+    ::close( fd );
+    return false;
+  }
+
+  // reserve one byte past the end of the file for the terminator. the
+  // file mapping zero-fills the rest of its last page; when the file ends
+  // exactly on a page boundary the anonymous page behind it provides it.
+  size_t pageSize = size_t( ::sysconf( _SC_PAGESIZE ) );
+  size_t mappedSize =
+    ( ( size_t( fileSize ) + 1 + pageSize - 1 ) / pageSize ) * pageSize;
+
+  void *reserved = ::mmap(
+    NULL, mappedSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+    );
+  if ( reserved == MAP_FAILED )
+  {
+    ::close( fd );
+    return false;
+  }
+
+  void *mapped = ::mmap(
+    reserved, size_t( fileSize ), PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0
+    );
+  ::close( fd );
+  if ( mapped == MAP_FAILED )
+  {
+    ::munmap( reserved, mappedSize );
+    return false;
+  }
+
+  ::madvise( mapped, size_t( fileSize ), MADV_SEQUENTIAL );
+
+  m_data = static_cast<char *>( mapped );
+  m_size = fileSize;
+  m_mappedSize = mappedSize;
+  m_isMapped = true;
+  return true;
+}
+
+#else
+
+bool MappedFile::open( char const *filePath )
+{
+  close();
+
+  FILE *file = fopen( filePath, "rb" );
+  if ( !file )
+    return false;
+
+  _fseeki64( file, 0, SEEK_END );
+  uint64_t fileSize = uint64_t( _ftelli64( file ) );
+  _fseeki64( file, 0, SEEK_SET );
+  if ( fileSize >= uint64_t( size_t( -1 ) ) )
+  {
+    fclose( file );
+    return false;
+  }
+
+  char *data = static_cast<char *>( malloc( size_t( fileSize ) + 1 ) );
+  if ( !data )
+  {
+    fclose( file );
+    return false;
+  }
+
+  uint64_t offset = 0;
+  while ( offset < fileSize )
+  {
+    size_t count = fread( data + offset, 1, size_t( fileSize - offset ), file );
+    if ( count == 0 )
+      break;
+    offset += count;
+  }
+  fclose( file );
+
+  if ( offset != fileSize )
+  {
+    free( data );
+    return false;
+  }
+  data[fileSize] = '\0';
+
+  m_data = data;
+  m_size = fileSize;
+  m_isMapped = false;
+  return true;
+}
+
+#endif
+
+void MappedFile::close()
+{
+  if ( m_data && m_data != sEmptyData )
+  {
+#if defined(FTL_PLATFORM_POSIX)
+    if ( m_isMapped )
+      ::munmap( m_data, m_mappedSize );
+    else
+#endif
+      free( m_data );
+  }
+
+  m_data = NULL;
+  m_size = 0;
+  m_mappedSize = 0;
+  m_isMapped = false;
+}
+
+AtomicFile::AtomicFile()
+  : m_file( NULL )
+  , m_failed( false )
+{
+}
+
+AtomicFile::~AtomicFile()
+{
+  abort();
+}
+
+bool AtomicFile::open( std::string const &filePath )
+{
+  abort();
+
+  m_filePath = filePath;
+  m_tmpFilePath = filePath;
+  m_tmpFilePath += ".tmp";
+  m_file = fopen( m_tmpFilePath.c_str(), "wb" );
+  m_failed = m_file == NULL;
+  return !m_failed;
+}
+
+bool AtomicFile::write( char const *data, uint64_t size )
+{
+  if ( !m_file || m_failed )
+    return false;
+
+  uint64_t offset = 0;
+  while ( offset < size )
+  {
+    size_t chunkSize = size_t( size - offset );
+    if ( chunkSize > ( 64u << 20 ) )
+      chunkSize = 64u << 20;
+    size_t count = fwrite( data + offset, 1, chunkSize, m_file );
+    if ( count == 0 )
+    {
+      m_failed = true;
+      return false;
+    }
+    offset += count;
+  }
+  return true;
+}
+
+bool AtomicFile::commit()
+{
+  if ( !m_file )
+    return false;
+
+  if ( fflush( m_file ) != 0 )
+    m_failed = true;
+  fclose( m_file );
+  m_file = NULL;
+
+  if ( m_failed )
+  {
+    FTL::FSMaybeDeleteFile( m_tmpFilePath );
+    return false;
+  }
+
+  FTL::FSMaybeMoveFile( m_tmpFilePath, m_filePath );
+  return true;
+}
+
+void AtomicFile::abort()
+{
+  if ( m_file )
+  {
+    fclose( m_file );
+    m_file = NULL;
+    FTL::FSMaybeDeleteFile( m_tmpFilePath );
+  }
+  m_failed = false;
+}
+
+bool WriteFileAtomically(
+  std::string const &filePath,
+  char const *data,
+  uint64_t size
+  )
+{
+  AtomicFile file;
+  return file.open( filePath )
+    && file.write( data, size )
+    && file.commit();
+}
+
+// .canvasz layout, in little-endian byte order:
+//   header:   "CNVZ", uint32 version, uint64 JSON size, uint32 block size,
+//             uint32 payload count (from version 2)
+//   blocks:   uint32 compressed size, uint32 inflated size, qCompress() output
+//   end:      uint32 0
+//   payloads: uint64 offset in the JSON, uint32 element type, uint64 element
+//             count, then the raw elements as blocks and an end
+// The JSON is the graph with its large numeric arrays, typically default
+// values, taken out; each payload is put back at its offset as a JSON array
+// when the document is read. Version 1 files have no payloads.
+static const char sCompressedMagic[4] = { 'C', 'N', 'V', 'Z' };
+static const uint32_t sCompressedVersion = 2;
+static const uint32_t sCompressedBlockSize = 1u << 20;
+
+// smaller arrays stay in the JSON
+static const uint64_t sPayloadMinElementCount = 256;
+
+enum PayloadType
+{
+  PayloadType_SInt32 = 1,
+  PayloadType_Float64 = 2
+};
+
+struct Payload
+{
+  // of the array in the source JSON, ']' included
+  uint64_t begin;
+  uint64_t end;
+  uint32_t type;
+  uint64_t count;
+};
+
+static void AppendUInt32( QByteArray &out, uint32_t value )
+{
+  for ( unsigned i = 0; i < 4; ++i )
+    out.append( char( ( value >> ( 8 * i ) ) & 0xFF ) );
+}
+
+static void AppendUInt64( QByteArray &out, uint64_t value )
+{
+  AppendUInt32( out, uint32_t( value ) );
+  AppendUInt32( out, uint32_t( value >> 32 ) );
+}
+
+static bool ReadUInt32( char const *&cursor, char const *end, uint32_t &value )
+{
+  if ( end - cursor < 4 )
+    return false;
+  value = 0;
+  for ( unsigned i = 0; i < 4; ++i )
+    value |= uint32_t( uint8_t( cursor[i] ) ) << ( 8 * i );
+  cursor += 4;
+  return true;
+}
+
+static bool ReadUInt64( char const *&cursor, char const *end, uint64_t &value )
+{
+  uint32_t low, high;
+  if ( !ReadUInt32( cursor, end, low ) || !ReadUInt32( cursor, end, high ) )
+    return false;
+  value = uint64_t( low ) | ( uint64_t( high ) << 32 );
+  return true;
+}
+
+static bool IsJSONSpace( char c )
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool IsJSONNumberChar( char c )
+{
+  return ( c >= '0' && c <= '9' )
+    || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+// the number token at cursor, as the type it would be stored with
+static bool ParseNumber(
+  char const *&cursor,
+  char const *end,
+  uint32_t &type,
+  int &intValue,
+  double &floatValue
+  )
+{
+  char const *begin = cursor;
+  bool isInteger = true;
+  while ( cursor < end && IsJSONNumberChar( *cursor ) )
+  {
+    if ( *cursor == '.' || *cursor == 'e' || *cursor == 'E' )
+      isInteger = false;
+    ++cursor;
+  }
+  if ( cursor == begin )
+    return false;
+
+  // QByteArray conversions use the C locale, whatever the application's
+  QByteArray token =
+    QByteArray::fromRawData( begin, int( cursor - begin ) );
+  bool ok = false;
+  if ( isInteger )
+  {
+    // larger integers would not survive a trip through a Float64
+    intValue = token.toInt( &ok );
+    type = PayloadType_SInt32;
+    return ok;
+  }
+  floatValue = token.toDouble( &ok );
+  if ( !ok || floatValue - floatValue != 0.0 )
+    return false;
+  type = PayloadType_Float64;
+  return true;
+}
+
+// the array opening at cursor, if it holds numbers only
+static bool ScanNumericArray(
+  char const *json,
+  uint64_t jsonSize,
+  uint64_t begin,
+  Payload &payload
+  )
+{
+  char const *cursor = json + begin + 1;
+  char const *end = json + jsonSize;
+
+  payload.begin = begin;
+  payload.type = PayloadType_SInt32;
+  payload.count = 0;
+  for (;;)
+  {
+    while ( cursor < end && IsJSONSpace( *cursor ) )
+      ++cursor;
+    uint32_t type;
+    int intValue;
+    double floatValue;
+    if ( !ParseNumber( cursor, end, type, intValue, floatValue ) )
+      return false;
+    if ( type == PayloadType_Float64 )
+      payload.type = PayloadType_Float64;
+    ++payload.count;
+
+    while ( cursor < end && IsJSONSpace( *cursor ) )
+      ++cursor;
+    if ( cursor == end )
+      return false;
+    if ( *cursor == ']' )
+    {
+      payload.end = uint64_t( cursor + 1 - json );
+      return true;
+    }
+    if ( *cursor != ',' )
+      return false;
+    ++cursor;
+  }
+}
+
+static void FindPayloads(
+  char const *json,
+  uint64_t jsonSize,
+  std::vector<Payload> &payloads
+  )
+{
+  bool inString = false;
+  uint64_t i = 0;
+  while ( i < jsonSize )
+  {
+    char c = json[i];
+    if ( inString )
+    {
+      if ( c == '\\' )
+        ++i;
+      else if ( c == '"' )
+        inString = false;
+      ++i;
+      continue;
+    }
+
+    if ( c == '"' )
+      inString = true;
+    else if ( c == '[' )
+    {
+      Payload payload;
+      if ( ScanNumericArray( json, jsonSize, i, payload )
+        && payload.count >= sPayloadMinElementCount )
+      {
+        payloads.push_back( payload );
+        i = payload.end;
+        continue;
+      }
+    }
+    ++i;
+  }
+}
+
+// compresses what it is given into blocks of the container
+class BlockWriter
+{
+public:
+
+  BlockWriter( AtomicFile &file )
+    : m_file( file )
+  {
+  }
+
+  bool write( char const *data, uint64_t size )
+  {
+    while ( size > 0 )
+    {
+      uint64_t chunkSize = sCompressedBlockSize - uint32_t( m_block.size() );
+      if ( chunkSize > size )
+        chunkSize = size;
+      m_block.append( data, int( chunkSize ) );
+      data += chunkSize;
+      size -= chunkSize;
+      if ( uint32_t( m_block.size() ) == sCompressedBlockSize && !flush() )
+        return false;
+    }
+    return true;
+  }
+
+  bool finish()
+  {
+    if ( !flush() )
+      return false;
+    QByteArray trailer;
+    AppendUInt32( trailer, 0 );
+    return m_file.write( trailer.constData(), trailer.size() );
+  }
+
+private:
+
+  bool flush()
+  {
+    if ( m_block.isEmpty() )
+      return true;
+    QByteArray compressed = qCompress( m_block );
+    QByteArray blockHeader;
+    AppendUInt32( blockHeader, uint32_t( compressed.size() ) );
+    AppendUInt32( blockHeader, uint32_t( m_block.size() ) );
+    m_block.clear();
+    return m_file.write( blockHeader.constData(), blockHeader.size() )
+      && m_file.write( compressed.constData(), compressed.size() );
+  }
+
+  AtomicFile &m_file;
+  QByteArray m_block;
+};
+
+// the next block at cursor; block is left empty at the end of the blocks
+static bool ReadBlock(
+  char const *&cursor,
+  char const *end,
+  uint32_t blockSize,
+  QByteArray &block
+  )
+{
+  block.clear();
+
+  uint32_t compressedSize;
+  uint32_t inflatedSize;
+  if ( !ReadUInt32( cursor, end, compressedSize ) )
+    return false;
+  if ( compressedSize == 0 )
+    return true;
+  if ( !ReadUInt32( cursor, end, inflatedSize )
+    || inflatedSize == 0
+    || inflatedSize > blockSize
+    || uint64_t( end - cursor ) < compressedSize )
+    return false;
+
+  block = qUncompress(
+    reinterpret_cast<uchar const *>( cursor ), int( compressedSize )
+    );
+  cursor += compressedSize;
+  return uint32_t( block.size() ) == inflatedSize;
+}
+
+// reads the elements of a payload and appends them to json as an array
+static bool InflatePayload(
+  char const *&cursor,
+  char const *end,
+  uint32_t blockSize,
+  uint32_t type,
+  uint64_t count,
+  std::string &json
+  )
+{
+  uint32_t elementSize;
+  if ( type == PayloadType_SInt32 )
+    elementSize = 4;
+  else if ( type == PayloadType_Float64 )
+    elementSize = 8;
+  else
+    return false;
+
+  json += '[';
+  uint64_t elementCount = 0;
+  QByteArray block;
+  for (;;)
+  {
+    if ( !ReadBlock( cursor, end, blockSize, block ) )
+      return false;
+    if ( block.isEmpty() )
+      break;
+    if ( uint32_t( block.size() ) % elementSize != 0 )
+      return false;
+
+    char const *elementCursor = block.constData();
+    char const *elementEnd = elementCursor + block.size();
+    while ( elementCursor < elementEnd )
+    {
+      if ( elementCount > 0 )
+        json += ',';
+      ++elementCount;
+
+      if ( type == PayloadType_SInt32 )
+      {
+        uint32_t value;
+        ReadUInt32( elementCursor, elementEnd, value );
+        QByteArray text = QByteArray::number( int32_t( value ) );
+        json.append( text.constData(), text.size() );
+        continue;
+      }
+
+      uint64_t bits;
+      ReadUInt64( elementCursor, elementEnd, bits );
+      double value;
+      memcpy( &value, &bits, sizeof( value ) );
+
+      // the shortest text that reads back as the same value
+      QByteArray text;
+      for ( int precision = 15; precision <= 17; ++precision )
+      {
+        text = QByteArray::number( value, 'g', precision );
+        if ( text.toDouble() == value )
+          break;
+      }
+      json.append( text.constData(), text.size() );
+      // stays a floating point value for the decoder
+      if ( text.indexOf( '.' ) < 0
+        && text.indexOf( 'e' ) < 0
+        && text.indexOf( 'E' ) < 0 )
+        json += ".0";
+    }
+  }
+  json += ']';
+  return elementCount == count;
+}
+
+bool IsCompressedCanvasPath( std::string const &filePath )
+{
+  static const char extension[] = ".canvasz";
+  size_t extensionLength = sizeof( extension ) - 1;
+  if ( filePath.size() < extensionLength )
+    return false;
+  for ( size_t i = 0; i < extensionLength; ++i )
+  {
+    char c = filePath[filePath.size() - extensionLength + i];
+    if ( c >= 'A' && c <= 'Z' )
+      c = c - 'A' + 'a';
+    if ( c != extension[i] )
+      return false;
+  }
+  return true;
+}
+
+CanvasDocument::CanvasDocument()
+  : m_isCompressed( false )
+{
+}
+
+bool CanvasDocument::open( char const *filePath )
+{
+  m_inflated.clear();
+  m_isCompressed = false;
+
+  if ( !m_file.open( filePath ) )
+    return false;
+
+  char const *cursor = m_file.data();
+  char const *end = cursor + m_file.size();
+  if ( m_file.size() < sizeof( sCompressedMagic )
+    || memcmp( cursor, sCompressedMagic, sizeof( sCompressedMagic ) ) != 0 )
+    return true;
+
+  m_isCompressed = true;
+  cursor += sizeof( sCompressedMagic );
+
+  uint32_t version;
+  uint64_t jsonSize;
+  uint32_t blockSize;
+  uint32_t payloadCount = 0;
+  if ( !ReadUInt32( cursor, end, version )
+    || version < 1 || version > sCompressedVersion
+    || !ReadUInt64( cursor, end, jsonSize )
+    || !ReadUInt32( cursor, end, blockSize )
+    || ( version >= 2 && !ReadUInt32( cursor, end, payloadCount ) )
+    || jsonSize >= uint64_t( size_t( -1 ) ) )
+  {
+    m_file.close();
+    return false;
+  }
+
+  // blocks are inflated one at a time straight into the document
+  std::string structure;
+  structure.reserve( size_t( jsonSize ) + 1 );
+  QByteArray block;
+  for (;;)
+  {
+    if ( !ReadBlock( cursor, end, blockSize, block ) )
+      break;
+    if ( block.isEmpty() )
+    {
+      if ( structure.size() != jsonSize )
+        break;
+
+      // the payloads are in the order of their offsets
+      uint64_t copiedSize = 0;
+      for ( uint32_t i = 0; i < payloadCount; ++i )
+      {
+        uint64_t offset;
+        uint32_t type;
+        uint64_t count;
+        if ( !ReadUInt64( cursor, end, offset )
+          || !ReadUInt32( cursor, end, type )
+          || !ReadUInt64( cursor, end, count )
+          || offset < copiedSize
+          || offset > jsonSize )
+        {
+          m_file.close();
+          m_inflated.clear();
+          return false;
+        }
+        m_inflated.append(
+          structure, size_t( copiedSize ), size_t( offset - copiedSize )
+          );
+        copiedSize = offset;
+        if ( !InflatePayload( cursor, end, blockSize, type, count, m_inflated ) )
+        {
+          m_file.close();
+          m_inflated.clear();
+          return false;
+        }
+      }
+      if ( payloadCount == 0 )
+        m_inflated.swap( structure );
+      else
+        m_inflated.append( structure, size_t( copiedSize ), std::string::npos );
+
+      m_file.close();
+      return true;
+    }
+    structure.append( block.constData(), block.size() );
+  }
+
+  m_file.close();
+  m_inflated.clear();
+  return false;
+}
+
+void CanvasDocument::close()
+{
+  m_file.close();
+  std::string().swap( m_inflated );
+  m_isCompressed = false;
+}
+
+char const *CanvasDocument::json() const
+{
+  return m_isCompressed? m_inflated.c_str(): m_file.data();
+}
+
+uint64_t CanvasDocument::jsonSize() const
+{
+  return m_isCompressed? uint64_t( m_inflated.size() ): m_file.size();
+}
+
+bool WriteCanvasDocument(
+  std::string const &filePath,
+  char const *json,
+  uint64_t jsonSize
+  )
+{
+  if ( !IsCompressedCanvasPath( filePath ) )
+    return WriteFileAtomically( filePath, json, jsonSize );
+
+  std::vector<Payload> payloads;
+  FindPayloads( json, jsonSize, payloads );
+
+  uint64_t structureSize = jsonSize;
+  for ( size_t i = 0; i < payloads.size(); ++i )
+    structureSize -= payloads[i].end - payloads[i].begin;
+
+  AtomicFile file;
+  if ( !file.open( filePath ) )
+    return false;
+
+  QByteArray header;
+  header.append( sCompressedMagic, sizeof( sCompressedMagic ) );
+  AppendUInt32( header, sCompressedVersion );
+  AppendUInt64( header, structureSize );
+  AppendUInt32( header, sCompressedBlockSize );
+  AppendUInt32( header, uint32_t( payloads.size() ) );
+  if ( !file.write( header.constData(), header.size() ) )
+    return false;
+
+  // the JSON around the payloads; each block is compressed and written
+  // before the next one is filled
+  {
+    BlockWriter writer( file );
+    uint64_t offset = 0;
+    for ( size_t i = 0; i < payloads.size(); ++i )
+    {
+      if ( !writer.write( json + offset, payloads[i].begin - offset ) )
+        return false;
+      offset = payloads[i].end;
+    }
+    if ( !writer.write( json + offset, jsonSize - offset )
+      || !writer.finish() )
+      return false;
+  }
+
+  uint64_t removedSize = 0;
+  for ( size_t i = 0; i < payloads.size(); ++i )
+  {
+    Payload const &payload = payloads[i];
+
+    QByteArray payloadHeader;
+    AppendUInt64( payloadHeader, payload.begin - removedSize );
+    AppendUInt32( payloadHeader, payload.type );
+    AppendUInt64( payloadHeader, payload.count );
+    if ( !file.write( payloadHeader.constData(), payloadHeader.size() ) )
+      return false;
+    removedSize += payload.end - payload.begin;
+
+    // the elements were validated by FindPayloads
+    BlockWriter writer( file );
+    char const *cursor = json + payload.begin + 1;
+    char const *end = json + payload.end;
+    QByteArray element;
+    for ( uint64_t j = 0; j < payload.count; ++j )
+    {
+      while ( IsJSONSpace( *cursor ) || *cursor == ',' )
+        ++cursor;
+      uint32_t type;
+      int intValue;
+      double floatValue;
+      ParseNumber( cursor, end, type, intValue, floatValue );
+
+      element.clear();
+      if ( payload.type == PayloadType_SInt32 )
+        AppendUInt32( element, uint32_t( intValue ) );
+      else
+      {
+        if ( type == PayloadType_SInt32 )
+          floatValue = double( intValue );
+        uint64_t bits;
+        memcpy( &bits, &floatValue, sizeof( bits ) );
+        AppendUInt64( element, bits );
+      }
+      if ( !writer.write( element.constData(), element.size() ) )
+        return false;
+    }
+    if ( !writer.finish() )
+      return false;
+  }
+
+  return file.commit();
+}
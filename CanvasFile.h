@@ -0,0 +1,118 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_FILE_H__
+#define __CANVAS_FILE_H__
+
+#include <FTL/Config.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+// Read-only view of a whole file, always followed by a null character so
+// that the contents can be handed to the core as a C string without being
+// copied. On POSIX platforms the file is memory-mapped; elsewhere it is read
+// into a single buffer.
+class MappedFile
+{
+public:
+
+  MappedFile();
+  ~MappedFile();
+
+  bool open( char const *filePath );
+  void close();
+
+  bool isOpen() const
+    { return m_data != NULL; }
+
+  char const *data() const
+    { return m_data; }
+  uint64_t size() const
+    { return m_size; }
+
+private:
+
+  MappedFile( MappedFile const & );
+  MappedFile &operator=( MappedFile const & );
+
+  char *m_data;
+  uint64_t m_size;
+  size_t m_mappedSize;
+  bool m_isMapped;
+};
+
+// Writes to a temporary file next to filePath, then moves it over filePath
+// on commit(), so that readers never observe a partially written file.
+// Nothing is left behind if the file is destroyed without being committed.
+class AtomicFile
+{
+public:
+
+  AtomicFile();
+  ~AtomicFile();
+
+  bool open( std::string const &filePath );
+  bool write( char const *data, uint64_t size );
+  bool commit();
+  void abort();
+
+private:
+
+  AtomicFile( AtomicFile const & );
+  AtomicFile &operator=( AtomicFile const & );
+
+  std::string m_filePath;
+  std::string m_tmpFilePath;
+  FILE *m_file;
+  bool m_failed;
+};
+
+bool WriteFileAtomically(
+  std::string const &filePath,
+  char const *data,
+  uint64_t size
+  );
+
+// A graph document read from either a plain .canvas file or a compressed
+// .canvasz container, detected from the contents. Plain files are exposed
+// straight from the mapping; containers are inflated block by block, and
+// their typed numeric blocks are turned back into JSON arrays.
+class CanvasDocument
+{
+public:
+
+  CanvasDocument();
+
+  bool open( char const *filePath );
+  void close();
+
+  bool isCompressed() const
+    { return m_isCompressed; }
+
+  // null-terminated JSON
+  char const *json() const;
+  uint64_t jsonSize() const;
+
+private:
+
+  MappedFile m_file;
+  std::string m_inflated;
+  bool m_isCompressed;
+};
+
+bool IsCompressedCanvasPath( std::string const &filePath );
+
+// writes a .canvasz container if filePath has that extension, plain JSON
+// otherwise; in a container, large numeric arrays are stored as raw SInt32
+// or Float64 blocks
+bool WriteCanvasDocument(
+  std::string const &filePath,
+  char const *json,
+  uint64_t jsonSize
+  );
+
+#endif // __CANVAS_FILE_H__
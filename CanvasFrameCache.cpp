@@ -0,0 +1,391 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasFrameCache.h"
+
+#include <FabricUI/Viewports/TimeLineWidget.h>
+
+#include <FTL/StrRef.h>
+
+#include <QtGui/QPainter>
+
+#include <algorithm>
+
+bool CopyFrameOutputs(
+  FabricCore::Client const &client,
+  FabricCore::DFGBinding &binding,
+  std::vector<FrameCacheValue> &values
+  )
+{
+  FabricCore::DFGExec exec = binding.getExec();
+  unsigned portCount = exec.getExecPortCount();
+  for ( unsigned i = 0; i < portCount; ++i )
+  {
+    if ( exec.getExecPortType( i ) == FabricCore::DFGPortType_In )
+      continue;
+
+    FrameCacheValue cacheValue;
+    cacheValue.portName = exec.getExecPortName( i );
+    FabricCore::RTVal value =
+      binding.getArgValue( cacheValue.portName.c_str() );
+    if ( !value.isValid() )
+      continue;
+
+    // objects are shared with the graph and cannot be restored later
+    if ( value.isObject() || value.isInterface() )
+      return false;
+
+    // copy construct, so that the next evaluation leaves it untouched
+    cacheValue.value = FabricCore::RTVal::Construct(
+      client, value.getTypeNameCStr(), 1, &value
+      );
+    values.push_back( cacheValue );
+  }
+  return true;
+}
+
+bool HasInlineDrawing( FabricCore::Client const &client )
+{
+  try
+  {
+    FabricCore::RTVal drawing =
+      FabricCore::RTVal::Create( client, "OGLInlineDrawing", 0, 0 );
+    drawing = drawing.callMethod( "OGLInlineDrawing", "getInstance", 0, 0 );
+    return drawing.callMethod( "Size", "getShapeCount", 0, 0 ).getUInt64() > 0;
+  }
+  catch ( FabricCore::Exception e )
+  {
+    // without the extension, nothing can be drawn
+    return false;
+  }
+}
+
+static void AddTypeUsage( FTL::StrRef name, GraphUsage &usage )
+{
+  // the element type of arrays and dictionaries
+  for ( size_t i = 0; i < name.size(); ++i )
+  {
+    if ( name.data()[i] == '[' || name.data()[i] == '<' )
+    {
+      name = FTL::StrRef( name.data(), i );
+      break;
+    }
+  }
+
+  if ( name == FTL_STR("EvalContext") )
+    usage.readsEvalContext = true;
+  else if ( name == FTL_STR("DrawingHandle")
+    || name.startswith( FTL_STR("Inline") )
+    || name.startswith( FTL_STR("OGLInline") ) )
+    usage.drawsInline = true;
+}
+
+static bool IsKLIdentifierChar( char c )
+{
+  return ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' )
+    || ( c >= '0' && c <= '9' ) || c == '_';
+}
+
+// the identifiers of the code, comments and string literals left out
+static void AddCodeUsage( char const *code, GraphUsage &usage )
+{
+  char const *cursor = code;
+  while ( *cursor )
+  {
+    if ( cursor[0] == '/' && cursor[1] == '/' )
+    {
+      while ( *cursor && *cursor != '\n' )
+        ++cursor;
+    }
+    else if ( cursor[0] == '/' && cursor[1] == '*' )
+    {
+      cursor += 2;
+      while ( *cursor && !( cursor[0] == '*' && cursor[1] == '/' ) )
+        ++cursor;
+      if ( *cursor )
+        cursor += 2;
+    }
+    else if ( *cursor == '"' || *cursor == '\'' )
+    {
+      char quote = *cursor++;
+      while ( *cursor && *cursor != quote )
+      {
+        if ( *cursor == '\\' && cursor[1] )
+          ++cursor;
+        ++cursor;
+      }
+      if ( *cursor )
+        ++cursor;
+    }
+    else if ( IsKLIdentifierChar( *cursor ) )
+    {
+      char const *begin = cursor;
+      while ( IsKLIdentifierChar( *cursor ) )
+        ++cursor;
+      if ( *begin < '0' || *begin > '9' )
+        AddTypeUsage( FTL::StrRef( begin, cursor - begin ), usage );
+    }
+    else
+      ++cursor;
+  }
+}
+
+static void AddExecUsage( FabricCore::DFGExec &exec, GraphUsage &usage )
+{
+  unsigned portCount = exec.getExecPortCount();
+  for ( unsigned i = 0; i < portCount; ++i )
+  {
+    char const *resolvedType = exec.getExecPortResolvedType( i );
+    if ( resolvedType )
+      AddTypeUsage( resolvedType, usage );
+  }
+
+  if ( exec.getType() == FabricCore::DFGExecType_Func )
+  {
+    char const *code = exec.getCode();
+    if ( code )
+      AddCodeUsage( code, usage );
+    return;
+  }
+
+  // presets are instantiated with their own copy of the executable, so
+  // this also covers the ones referenced by path
+  unsigned nodeCount = exec.getNodeCount();
+  for ( unsigned i = 0;
+    i < nodeCount && !( usage.readsEvalContext && usage.drawsInline ); ++i )
+  {
+    char const *nodeName = exec.getNodeName( i );
+    if ( exec.getNodeType( nodeName ) != FabricCore::DFGNodeType_Inst )
+      continue;
+    FabricCore::DFGExec subExec = exec.getSubExec( nodeName );
+    AddExecUsage( subExec, usage );
+  }
+}
+
+GraphUsage FindGraphUsage( FabricCore::DFGExec &exec )
+{
+  GraphUsage usage;
+  usage.readsEvalContext = false;
+  usage.drawsInline = false;
+  AddExecUsage( exec, usage );
+  return usage;
+}
+
+FrameCache::FrameCache()
+  : m_budgetBytes( uint64_t( 512 ) << 20 )
+  , m_usedBytes( 0 )
+{
+}
+
+void FrameCache::setBudget( uint64_t budgetBytes )
+{
+  m_budgetBytes = budgetBytes;
+  evict();
+}
+
+void FrameCache::insert(
+  uint32_t version,
+  int frame,
+  std::vector<FrameCacheValue> const &values
+  )
+{
+  Key key( version, frame );
+  EntryMap::iterator it = m_entryMap.find( key );
+  if ( it != m_entryMap.end() )
+  {
+    m_usedBytes -= it->second->bytes;
+    m_entries.erase( it->second );
+    m_entryMap.erase( it );
+  }
+
+  uint64_t bytes = 0;
+  for ( size_t i = 0; i < values.size(); ++i )
+    bytes += EstimateBytes( values[i].value );
+
+  // a single frame larger than the whole budget is not worth keeping
+  if ( bytes > m_budgetBytes )
+    return;
+
+  Entry entry;
+  entry.version = version;
+  entry.frame = frame;
+  entry.values = values;
+  entry.bytes = bytes;
+  m_entries.push_front( entry );
+  m_entryMap[key] = m_entries.begin();
+  m_usedBytes += bytes;
+
+  evict();
+}
+
+std::vector<FrameCacheValue> const *FrameCache::lookup(
+  uint32_t version,
+  int frame
+  )
+{
+  EntryMap::iterator it = m_entryMap.find( Key( version, frame ) );
+  if ( it == m_entryMap.end() )
+    return NULL;
+
+  m_entries.splice( m_entries.begin(), m_entries, it->second );
+  return &it->second->values;
+}
+
+bool FrameCache::contains( uint32_t version, int frame ) const
+{
+  return m_entryMap.find( Key( version, frame ) ) != m_entryMap.end();
+}
+
+void FrameCache::clear()
+{
+  m_entries.clear();
+  m_entryMap.clear();
+  m_usedBytes = 0;
+}
+
+void FrameCache::evict()
+{
+  while ( m_usedBytes > m_budgetBytes && !m_entries.empty() )
+  {
+    Entry const &entry = m_entries.back();
+    m_usedBytes -= entry.bytes;
+    m_entryMap.erase( Key( entry.version, entry.frame ) );
+    m_entries.pop_back();
+  }
+}
+
+static uint64_t EstimateTypeBytes( std::string const &typeName )
+{
+  struct TypeSize
+  {
+    char const *name;
+    uint64_t bytes;
+  };
+  static const TypeSize typeSizes[] =
+  {
+    { "Boolean", 1 },
+    { "UInt8", 1 },
+    { "SInt8", 1 },
+    { "UInt16", 2 },
+    { "SInt16", 2 },
+    { "UInt32", 4 },
+    { "SInt32", 4 },
+    { "Float32", 4 },
+    { "UInt64", 8 },
+    { "SInt64", 8 },
+    { "Float64", 8 },
+    { "Vec2", 8 },
+    { "Vec3", 12 },
+    { "Vec4", 16 },
+    { "Quat", 16 },
+    { "Color", 16 },
+    { "RGBA", 4 },
+    { "Euler", 16 },
+    { "Xfo", 40 },
+    { "Mat33", 36 },
+    { "Mat44", 64 },
+  };
+  for ( size_t i = 0; i < sizeof( typeSizes ) / sizeof( typeSizes[0] ); ++i )
+  {
+    if ( typeName == typeSizes[i].name )
+      return typeSizes[i].bytes;
+  }
+  return 64;
+}
+
+uint64_t FrameCache::EstimateBytes( FabricCore::RTVal const &value )
+{
+  // overhead of the handle itself
+  uint64_t bytes = 32;
+  try
+  {
+    FabricCore::RTVal &mutableValue = const_cast<FabricCore::RTVal &>( value );
+    std::string typeName = mutableValue.getTypeNameCStr();
+    if ( mutableValue.isArray() )
+    {
+      std::string elementTypeName =
+        typeName.substr( 0, typeName.find( '[' ) );
+      bytes += uint64_t( mutableValue.getArraySize() )
+        * EstimateTypeBytes( elementTypeName );
+    }
+    else if ( mutableValue.isString() )
+      bytes += mutableValue.getStringLength();
+    else
+      bytes += EstimateTypeBytes( typeName );
+  }
+  catch ( FabricCore::Exception e )
+  {
+  }
+  return bytes;
+}
+
+FrameCacheBar::FrameCacheBar(
+  FrameCache const *cache,
+  FabricUI::Viewports::TimeLineWidget *timeLine,
+  QWidget *parent
+  )
+  : QWidget( parent )
+  , m_cache( cache )
+  , m_timeLine( timeLine )
+  , m_version( 0 )
+  , m_cacheable( true )
+{
+  setSizePolicy( QSizePolicy::Expanding, QSizePolicy::Fixed );
+  setToolTip( "Frames in the playback cache" );
+}
+
+void FrameCacheBar::setVersion( uint32_t version )
+{
+  m_version = version;
+  update();
+}
+
+void FrameCacheBar::setCacheable( bool cacheable )
+{
+  if ( m_cacheable == cacheable )
+    return;
+  m_cacheable = cacheable;
+  setToolTip(
+    cacheable?
+      "Frames in the playback cache":
+      "Not cached: the graph draws in the viewport, and only the values "
+      "of output ports can be cached"
+    );
+  update();
+}
+
+QSize FrameCacheBar::sizeHint() const
+{
+  return QSize( 100, 4 );
+}
+
+void FrameCacheBar::paintEvent( QPaintEvent *event )
+{
+  int rangeStart = int( m_timeLine->getRangeStart() );
+  int rangeEnd = int( m_timeLine->getRangeEnd() );
+  if ( rangeEnd < rangeStart )
+    return;
+
+  QPainter painter( this );
+  painter.fillRect( rect(), palette().color( QPalette::Window ).darker( 120 ) );
+  if ( !m_cacheable )
+  {
+    painter.fillRect(
+      rect(),
+      QBrush( palette().color( QPalette::Mid ), Qt::BDiagPattern )
+      );
+    return;
+  }
+
+  double frameWidth = double( width() ) / double( rangeEnd - rangeStart + 1 );
+  QColor cachedColor( 96, 160, 224 );
+  for ( int frame = rangeStart; frame <= rangeEnd; ++frame )
+  {
+    if ( !m_cache->contains( m_version, frame ) )
+      continue;
+    int x0 = int( double( frame - rangeStart ) * frameWidth );
+    int x1 = int( double( frame - rangeStart + 1 ) * frameWidth );
+    painter.fillRect( x0, 0, std::max( x1 - x0, 1 ), height(), cachedColor );
+  }
+}
@@ -0,0 +1,142 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_FRAMECACHE_H__
+#define __CANVAS_FRAMECACHE_H__
+
+#include <FabricCore.h>
+
+#include <QtGui/QWidget>
+
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace FabricUI { namespace Viewports { class TimeLineWidget; } }
+
+struct FrameCacheValue
+{
+  std::string portName;
+  FabricCore::RTVal value;
+};
+
+// copies the values of the binding's output ports, so that later
+// evaluations leave them untouched. returns false if the outputs cannot
+// be cached, ie. if one of them is an object or an interface.
+bool CopyFrameOutputs(
+  FabricCore::Client const &client,
+  FabricCore::DFGBinding &binding,
+  std::vector<FrameCacheValue> &values
+  );
+
+// true if the last evaluation left shapes in the inline drawing. the
+// drawing is not part of the outputs, so the frames of such a graph
+// cannot be restored from the cache.
+bool HasInlineDrawing( FabricCore::Client const &client );
+
+// What a graph uses besides its arguments, found from the resolved types of
+// the ports and from the KL code of every executable it instantiates,
+// presets included
+struct GraphUsage
+{
+  // reads the EvalContext, whose time is shared by every binding
+  bool readsEvalContext;
+  // draws in the viewport through the inline drawing
+  bool drawsInline;
+};
+
+GraphUsage FindGraphUsage( FabricCore::DFGExec &exec );
+
+// Output port values of evaluated frames, kept in a least recently used
+// list bounded by a byte budget. Entries are keyed on (version, frame);
+// the caller bumps the version whenever an edit invalidates the results.
+// Only the outputs are kept, so only headless graphs, which draw nothing
+// in the viewport, can be restored from the cache.
+class FrameCache
+{
+public:
+
+  FrameCache();
+
+  void setBudget( uint64_t budgetBytes );
+  uint64_t budget() const
+    { return m_budgetBytes; }
+  uint64_t usedBytes() const
+    { return m_usedBytes; }
+
+  // the values must be copies that later evaluations cannot modify
+  void insert(
+    uint32_t version,
+    int frame,
+    std::vector<FrameCacheValue> const &values
+    );
+
+  // returns NULL on a miss; a hit becomes the most recently used entry
+  std::vector<FrameCacheValue> const *lookup(
+    uint32_t version,
+    int frame
+    );
+
+  bool contains( uint32_t version, int frame ) const;
+
+  void clear();
+
+  // rough size of a value, used to enforce the budget
+  static uint64_t EstimateBytes( FabricCore::RTVal const &value );
+
+private:
+
+  struct Entry
+  {
+    uint32_t version;
+    int frame;
+    std::vector<FrameCacheValue> values;
+    uint64_t bytes;
+  };
+  typedef std::list<Entry> EntryList;
+  typedef std::pair<uint32_t, int> Key;
+  typedef std::map<Key, EntryList::iterator> EntryMap;
+
+  void evict();
+
+  // most recently used first
+  EntryList m_entries;
+  EntryMap m_entryMap;
+  uint64_t m_budgetBytes;
+  uint64_t m_usedBytes;
+};
+
+// Thin strip shown under the timeline, marking the frames of the
+// current version that are in the cache. It is greyed out while the graph
+// cannot be cached.
+class FrameCacheBar : public QWidget
+{
+public:
+
+  FrameCacheBar(
+    FrameCache const *cache,
+    FabricUI::Viewports::TimeLineWidget *timeLine,
+    QWidget *parent = NULL
+    );
+
+  void setVersion( uint32_t version );
+  void setCacheable( bool cacheable );
+
+  virtual QSize sizeHint() const;
+
+protected:
+
+  virtual void paintEvent( QPaintEvent *event );
+
+private:
+
+  FrameCache const *m_cache;
+  FabricUI::Viewports::TimeLineWidget *m_timeLine;
+  uint32_t m_version;
+  bool m_cacheable;
+};
+
+#endif // __CANVAS_FRAMECACHE_H__
@@ -0,0 +1,92 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasLoad.h"
+#include "CanvasFile.h"
+#include "CanvasTrace.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QtConcurrentRun>
+
+GraphLoadResult::GraphLoadResult()
+  : jsonSize( 0 )
+  , parseSeconds( 0.0 )
+{
+}
+
+GraphLoader::GraphLoader(
+  FabricCore::DFGHost const &host,
+  QObject *parent
+  )
+  : QObject( parent )
+  , m_host( host )
+{
+  connect( &m_watcher, SIGNAL(finished()), this, SIGNAL(parsed()) );
+}
+
+GraphLoader::~GraphLoader()
+{
+  m_watcher.waitForFinished();
+}
+
+void GraphLoader::start( QString const &filePath, std::string const &json )
+{
+  m_watcher.waitForFinished();
+  m_filePath = filePath;
+  m_watcher.setFuture(
+    QtConcurrent::run(
+      &GraphLoader::Parse,
+      m_host,
+      std::string( filePath.toUtf8().constData() ),
+      json
+      )
+    );
+}
+
+void GraphLoader::waitForFinished()
+{
+  m_watcher.waitForFinished();
+}
+
+GraphLoadResult GraphLoader::Parse(
+  FabricCore::DFGHost host,
+  std::string filePath,
+  std::string json
+  )
+{
+  CANVAS_TRACE_SCOPE( "parseGraph" );
+
+  GraphLoadResult result;
+
+  CanvasDocument document;
+  char const *jsonData = json.c_str();
+  result.jsonSize = json.size();
+  if ( json.empty() )
+  {
+    if ( !document.open( filePath.c_str() ) )
+    {
+      result.error = "unable to read " + filePath;
+      return result;
+    }
+    // plain files are handed to the core straight from the mapping,
+    // without an intermediate copy
+    jsonData = document.json();
+    result.jsonSize = document.jsonSize();
+  }
+
+  QElapsedTimer parseTimer;
+  parseTimer.start();
+
+  try
+  {
+    result.binding = host.createBindingFromJSON( jsonData );
+  }
+  catch ( FabricCore::Exception e )
+  {
+    result.error = e.getDesc_cstr();
+  }
+
+  result.parseSeconds = double( parseTimer.nsecsElapsed() ) / 1.0e9;
+  return result;
+}
@@ -0,0 +1,72 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_LOAD_H__
+#define __CANVAS_LOAD_H__
+
+#include <FabricCore.h>
+
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+
+#include <stdint.h>
+#include <string>
+
+// The outcome of the worker stage of a graph load.
+struct GraphLoadResult
+{
+  FabricCore::DFGBinding binding;
+  // empty on success
+  std::string error;
+  uint64_t jsonSize;
+  double parseSeconds;
+
+  GraphLoadResult();
+};
+
+// Reads a graph document and creates its binding on a worker thread, so
+// that the UI stays responsive while large files are inflated and
+// parsed. The binding is handed back to the UI thread through parsed();
+// binding it to the controller and the first evaluation are left to the
+// caller.
+class GraphLoader : public QObject
+{
+  Q_OBJECT
+
+public:
+
+  GraphLoader( FabricCore::DFGHost const &host, QObject *parent = NULL );
+  ~GraphLoader();
+
+  // the file is read unless the JSON is given
+  void start( QString const &filePath, std::string const &json );
+  // blocks until the load in flight has been parsed
+  void waitForFinished();
+
+  bool isLoading() const
+    { return m_watcher.isRunning(); }
+  QString const &filePath() const
+    { return m_filePath; }
+  GraphLoadResult result() const
+    { return m_watcher.result(); }
+
+signals:
+
+  void parsed();
+
+private:
+
+  static GraphLoadResult Parse(
+    FabricCore::DFGHost host,
+    std::string filePath,
+    std::string json
+    );
+
+  FabricCore::DFGHost m_host;
+  QString m_filePath;
+  QFutureWatcher<GraphLoadResult> m_watcher;
+};
+
+#endif // __CANVAS_LOAD_H__
@@ -3,6 +3,8 @@
 //
 
 #include "CanvasMainWindow.h"
+#include "CanvasFile.h"
+#include "CanvasTrace.h"
 
 #include <FabricServices/Persistence/RTValToJSONEncoder.hpp>
 #include <FabricServices/Persistence/RTValFromJSONDecoder.hpp>
@@ -15,12 +17,16 @@
 
 #include <QtCore/QCoreApplication>
 #include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QThread>
 #include <QtCore/QTimer>
 #include <QtGui/QAction>
 #include <QtGui/QFileDialog>
 #include <QtGui/QMenu>
 #include <QtGui/QMenuBar>
 #include <QtGui/QMessageBox>
+#include <QtGui/QProgressBar>
+#include <QtGui/QPushButton>
 #include <QtGui/QUndoView>
 #include <QtGui/QVBoxLayout>
 
@@ -38,21 +44,75 @@ void MainWindow::CoreStatusCallback(
   MainWindow *mainWindow = reinterpret_cast<MainWindow *>( userdata );
   FTL::StrRef destination( destinationData, destinationLength );
   FTL::StrRef payload( payloadData, payloadLength );
-  if ( destination == FTL_STR( "licensing" ) )
+
+  if ( TraceRecorder::IsRecording() )
   {
-    try
-    {
-      FabricUI::HandleLicenseData(
-        mainWindow,
-        mainWindow->m_client,
-        payload,
-        true // modalDialogs
+    if ( destination == FTL_STR( "slowOp.push" ) )
+      TraceRecorder::Begin(
+        "slowOp",
+        std::string( payload.data(), payload.size() )
         );
-    }
-    catch ( FabricCore::Exception e )
-    {
-      DFG::DFGLogWidget::log( e.getDesc_cstr() );
-    }
+    else if ( destination == FTL_STR( "slowOp.pop" ) )
+      TraceRecorder::End( "slowOp" );
+    else
+      TraceRecorder::Instant(
+        "coreStatus",
+        std::string( destination.data(), destination.size() )
+          + ": " + std::string( payload.data(), payload.size() )
+        );
+  }
+
+  // the callback may come from the executor's thread; the widgets are
+  // only ever touched on the UI thread. on the UI thread itself, the
+  // handlers run right away, so that a push and its pop stay paired
+  // with the operation they describe
+  Qt::ConnectionType connectionType =
+    QThread::currentThread() == mainWindow->thread()?
+      Qt::DirectConnection: Qt::QueuedConnection;
+
+  if ( destination == FTL_STR( "slowOp.push" ) )
+  {
+    QMetaObject::invokeMethod(
+      mainWindow,
+      "onSlowOperationPushed",
+      connectionType,
+      Q_ARG( QString, QString::fromUtf8( payload.data(), int( payload.size() ) ) )
+      );
+  }
+  else if ( destination == FTL_STR( "slowOp.pop" ) )
+  {
+    QMetaObject::invokeMethod(
+      mainWindow,
+      "onSlowOperationPopped",
+      connectionType
+      );
+  }
+  else if ( destination == FTL_STR( "licensing" ) )
+  {
+    QMetaObject::invokeMethod(
+      mainWindow,
+      "onLicenseData",
+      connectionType,
+      Q_ARG( QString, QString::fromUtf8( payload.data(), int( payload.size() ) ) )
+      );
+  }
+}
+
+void MainWindow::onLicenseData( QString payload )
+{
+  try
+  {
+    QByteArray payloadUtf8 = payload.toUtf8();
+    FabricUI::HandleLicenseData(
+      this,
+      m_client,
+      FTL::StrRef( payloadUtf8.constData(), payloadUtf8.size() ),
+      true // modalDialogs
+      );
+  }
+  catch ( FabricCore::Exception e )
+  {
+    logError( e.getDesc_cstr() );
   }
 }
 
@@ -108,10 +168,13 @@ bool MainWindowEventFilter::eventFilter(
 
 MainWindow::MainWindow(
   QSettings *settings,
-  bool unguarded
+  MainWindowOptions const &options
   )
   : m_dfguiCommandHandler( &m_qUndoStack )
   , m_settings( settings )
+  , m_lazyStartup( options.lazyStartup )
+  , m_startupFinished( false )
+  , m_startupProfiler( options.startupProfiler )
 {
   std::stringstream autosaveBasename;
   autosaveBasename << FTL_STR("autosave.");
@@ -133,6 +196,12 @@ MainWindow::MainWindow(
     s_autosaveIntervalSec
     );
 
+  m_autosaveWriter = new AutosaveWriter( m_autosaveFilename, this );
+  connect(
+    m_autosaveWriter, SIGNAL(finished(bool, unsigned)),
+    this, SLOT(onAutosaveFinished(bool, unsigned))
+    );
+
   QTimer *autosaveTimer = new QTimer( this );
   connect(
     autosaveTimer, SIGNAL(timeout()),
@@ -156,24 +225,70 @@ MainWindow::MainWindow(
   m_resetCameraAction = NULL;
   m_clearLogAction = NULL;
   m_blockCompilationsAction = NULL;
+  m_deferCompilationsAction = NULL;
+  m_frameCacheAction = NULL;
+  m_traceAction = NULL;
 
   DockOptions dockOpt = dockOptions();
   dockOpt |= AllowNestedDocks;
   dockOpt ^= AllowTabbedDocks;
   setDockOptions(dockOpt);
-  m_timelinePortIndex = -1;
   m_viewport = NULL;
   m_timeLine = NULL;
   m_dfgWidget = NULL;
   m_dfgValueEditor = NULL;
   m_setGraph = NULL;
+  m_treeWidget = NULL;
+  m_logWidget = NULL;
+  m_droppedLogMessageCount = 0;
+  m_qUndoView = NULL;
+  m_undoEmptyLabel = "New Graph";
+  m_undoBudgetLabel = NULL;
+  m_undoTrimPending = false;
+  m_dfguiCommandHandler.setBudget(
+    uint64_t( m_settings->value( "undo/budgetMB", 1024 ).toUInt() ) << 20
+    );
+  m_dfguiCommandHandler.setMergeIntervalMS(
+    m_settings->value( "undo/mergeIntervalMs", 500 ).toUInt()
+    );
+  m_performanceWidget = NULL;
+
+  // graph evaluations run on the executor's thread; the results are
+  // picked up on the UI thread in onExecuted()
+  m_executor = new GraphExecutor( this );
+  m_dfguiCommandHandler.setExecutor( m_executor );
+  m_dfguiCommandHandler.setRootPorts( &m_rootPorts );
+  m_graphLoader = NULL;
+  m_graphLoadStage = GraphLoadStage_Idle;
+  m_graphLoadIsRecovery = false;
+  connect(
+    m_executor, SIGNAL(executed(double, int, unsigned)),
+    this, SLOT(onExecuted(double, int, unsigned))
+    );
+  connect(
+    m_executor, SIGNAL(executionFailed(QString)),
+    this, SLOT(onExecutionFailed(QString))
+    );
+  connect(
+    m_executor, SIGNAL(exported(QByteArray, unsigned)),
+    this, SLOT(onAutosaveExported(QByteArray, unsigned))
+    );
 
   DFG::DFGConfig config;
 
   m_slowOperationLabel = new QLabel();
+  m_slowOperationCancelButton = new QPushButton( "Cancel" );
+  m_slowOperationCancelButton->setToolTip(
+    "Drop the result of the running evaluation and stop playback"
+    );
+  connect(
+    m_slowOperationCancelButton, SIGNAL(clicked()),
+    this, SLOT(cancelSlowOperation())
+    );
 
   QLayout *slowOperationLayout = new QVBoxLayout();
   slowOperationLayout->addWidget( m_slowOperationLabel );
+  slowOperationLayout->addWidget( m_slowOperationCancelButton );
 
   m_slowOperationDialog = new QDialog( this );
   m_slowOperationDialog->setLayout( slowOperationLayout );
@@ -182,9 +297,55 @@ MainWindow::MainWindow(
   m_slowOperationDialog->setContentsMargins( 10, 10, 10, 10 );
   m_slowOperationDepth = 0;
   m_slowOperationTimer = new QTimer( this );
+  m_slowOperationTimer->setSingleShot( true );
+  m_slowOperationTimer->setInterval(
+    m_settings->value( "mainWindow/slowOperationDelayMs", 500 ).toInt()
+    );
   connect( m_slowOperationTimer, SIGNAL( timeout() ), m_slowOperationDialog, SLOT( show() ) );
+  m_slowOperationRefreshTimer = new QTimer( this );
+  m_slowOperationRefreshTimer->setInterval( 100 );
+  connect( m_slowOperationRefreshTimer, SIGNAL( timeout() ), this, SLOT( updateSlowOperationLabel() ) );
+
+  m_pendingUpdates = 0;
+  m_pendingUpdatesTimer.setSingleShot( true );
+  m_pendingUpdatesTimer.setInterval( 0 );
+  connect( &m_pendingUpdatesTimer, SIGNAL(timeout()), this, SLOT(flushPendingUpdates()) );
+  m_avoidedEvaluationCount = 0;
+
+  m_portDrivers.configure( m_settings );
+  m_lastDrivenFrame = TimeRange_Default_Frame_In - 1;
+
+  m_presetTreeRefreshPending = false;
+  m_presetTreeRefreshTimer.setSingleShot( true );
+  m_presetTreeRefreshTimer.setInterval(
+    m_settings->value( "explorer/refreshDelayMs", 100 ).toInt()
+    );
+  connect( &m_presetTreeRefreshTimer, SIGNAL(timeout()), this, SLOT(flushPresetTreeRefresh()) );
+
+  m_frameCacheEnabled = false;
+  m_frameCache.setBudget(
+    uint64_t( m_settings->value( "frameCache/budgetMB", 512 ).toUInt() ) << 20
+    );
+  m_frameCacheBar = NULL;
+  m_editGeneration = 0;
+  m_graphDrawsInline = false;
+  m_preroller = NULL;
+  m_extensionIndexer = NULL;
+  m_manipulationSession = NULL;
+  m_compileScheduler = NULL;
 
   m_statusBar = new QStatusBar(this);
+  m_compileQueueLabel = new QLabel( m_statusBar );
+  m_compileQueueLabel->setToolTip( "Compilations deferred while editing" );
+  m_statusBar->addPermanentWidget( m_compileQueueLabel );
+  m_avoidedEvaluationsLabel = new QLabel( m_statusBar );
+  m_avoidedEvaluationsLabel->setToolTip( "Evaluations avoided by merging notifications" );
+  m_statusBar->addPermanentWidget( m_avoidedEvaluationsLabel );
+  m_graphLoadProgressBar = new QProgressBar( m_statusBar );
+  m_graphLoadProgressBar->setRange( 0, 3 );
+  m_graphLoadProgressBar->setMaximumWidth( 240 );
+  m_graphLoadProgressBar->hide();
+  m_statusBar->addWidget( m_graphLoadProgressBar );
   m_fpsLabel = new QLabel( m_statusBar );
   m_statusBar->addPermanentWidget( m_fpsLabel );
   setStatusBar(m_statusBar);
@@ -193,43 +354,89 @@ MainWindow::MainWindow(
   m_fpsTimer.setInterval( 1000 );
   connect( &m_fpsTimer, SIGNAL(timeout()), this, SLOT(updateFPS()) );
   m_fpsTimer.start();
+  markStartupPhase( "windowSetup" );
 
   try
   {
-    FabricCore::Client::CreateOptions options;
-    memset( &options, 0, sizeof( options ) );
-    options.guarded = !unguarded;
-    options.optimizationType = FabricCore::ClientOptimizationType_Background;
-    options.licenseType = FabricCore::ClientLicenseType_Interactive;
-    options.rtValToJSONEncoder = &sRTValEncoder;
-    options.rtValFromJSONDecoder = &sRTValDecoder;
+    FabricCore::Client::CreateOptions clientOptions;
+    memset( &clientOptions, 0, sizeof( clientOptions ) );
+    clientOptions.guarded = !options.unguarded;
+    clientOptions.optimizationType = FabricCore::ClientOptimizationType_Background;
+    clientOptions.licenseType = FabricCore::ClientLicenseType_Interactive;
+    clientOptions.rtValToJSONEncoder = &sRTValEncoder;
+    clientOptions.rtValFromJSONDecoder = &sRTValDecoder;
     m_client = FabricCore::Client(
-      &DFG::DFGLogWidget::callback,
-      0,
-      &options
+      &MainWindow::LogCallback,
+      this,
+      &clientOptions
       );
+    markStartupPhase( "client" );
+
+    // Math and Util are needed by the viewport and the eval context;
+    // the others can wait for the first frame in lazy startup mode
     m_client.loadExtension("Math", "", false);
-    m_client.loadExtension("Parameters", "", false);
     m_client.loadExtension("Util", "", false);
+    m_deferredExtensions << "Parameters";
+    if ( !m_lazyStartup )
+      loadDeferredExtensions();
     m_client.setStatusCallback( &MainWindow::CoreStatusCallback, this );
+    markStartupPhase( "extensions" );
 
     m_manager = new ASTWrapper::KLASTManager(&m_client);
     // FE-4147
     // m_manager->loadAllExtensionsFromExtsPath();
+    // is too slow for startup; the extensions are parsed in the
+    // background once the first frame is drawn instead
+    std::string extensionIndexFilePath = fabricDir;
+    FTL::PathAppendEntry( extensionIndexFilePath, FTL_STR("astIndex") );
+    FTL::FSMkDir( extensionIndexFilePath.c_str() );
+    FTL::PathAppendEntry( extensionIndexFilePath, FTL_STR("extensions.idx") );
+    m_extensionIndexer = new ExtensionIndexer(
+      m_manager,
+      extensionIndexFilePath,
+      m_settings->value( "codeCompletion/indexIntervalMs", 10 ).toUInt(),
+      m_settings->value( "codeCompletion/parseSliceMs", 15 ).toUInt(),
+      m_settings->value( "codeCompletion/idleMs", 1000 ).toUInt(),
+      this
+      );
+    connect(
+      m_extensionIndexer, SIGNAL(finished(unsigned, unsigned)),
+      this, SLOT(onExtensionIndexFinished(unsigned, unsigned))
+      );
+    markStartupPhase( "astManager" );
 
     // construct the eval context rtval
     m_evalContext = FabricCore::RTVal::Create(m_client, "EvalContext", 0, 0);
     m_evalContext = m_evalContext.callMethod("EvalContext", "getInstance", 0, 0);
     m_evalContext.setMember("host", FabricCore::RTVal::ConstructString(m_client, "Canvas"));
     m_evalContext.setMember("graph", FabricCore::RTVal::ConstructString(m_client, ""));
+    m_evalContextTime = FabricCore::RTVal::ConstructFloat32(m_client, 0.0f);
 
     m_host = m_client.getDFGHost();
 
+    m_graphLoader = new GraphLoader( m_host, this );
+    connect( m_graphLoader, SIGNAL(parsed()), this, SLOT(onGraphParsed()) );
+
+    // look-ahead evaluations that feed the playback cache
+    int prerollThreadCount = QThread::idealThreadCount() / 2;
+    m_preroller = new FramePreroller(
+      m_client,
+      &m_frameCache,
+      m_settings->value(
+        "frameCache/lookAheadThreads",
+        prerollThreadCount > 1? prerollThreadCount: 1
+        ).toUInt(),
+      m_settings->value( "frameCache/lookAheadFrames", 4 ).toUInt(),
+      this
+      );
+
     FabricCore::DFGBinding binding = m_host.createBindingToNewGraph();
     m_lastSavedBindingVersion = binding.getVersion();
+    m_isUnsavedRecovery = false;
     m_lastAutosaveBindingVersion = m_lastSavedBindingVersion;
 
     FabricCore::DFGExec graph = binding.getExec();
+    markStartupPhase( "host" );
 
     QGLFormat glFormat;
     glFormat.setDoubleBuffer(true);
@@ -241,8 +448,9 @@ MainWindow::MainWindow(
     m_viewport = new Viewports::GLViewportWidget(&m_client, config.defaultWindowColor, glFormat, this, m_settings);
     setCentralWidget(m_viewport);
 
-    QObject::connect(this, SIGNAL(contentChanged()), m_viewport, SLOT(redraw()));
+    QObject::connect(this, SIGNAL(contentChanged()), this, SLOT(onContentChanged()));
     QObject::connect(m_viewport, SIGNAL(portManipulationRequested(QString)), this, SLOT(onPortManipulationRequested(QString)));
+    markStartupPhase( "viewport" );
 
     // graph view
     m_dfgWidget = new DFG::DFGWidget(
@@ -256,6 +464,30 @@ MainWindow::MainWindow(
       &m_dfguiCommandHandler,
       config
       );
+    markStartupPhase( "graphView" );
+
+    // drags of the viewport manipulators
+    m_manipulationSession = new ManipulationSession(
+      m_dfgWidget->getUIController(),
+      m_executor,
+      &m_qUndoStack,
+      m_settings->value( "manipulation/maxRateHz", 60 ).toUInt(),
+      this
+      );
+    m_viewport->installEventFilter( m_manipulationSession );
+
+    // structural edits in bursts are compiled once they stop
+    m_compileScheduler = new CompileScheduler(
+      m_dfgWidget->getUIController(),
+      m_executor,
+      m_settings->value( "compilation/idleMs", 1000 ).toUInt(),
+      this
+      );
+    m_compileScheduler->setEnabled(
+      m_settings->value( "compilation/deferWhileEditing", false ).toBool()
+      );
+    connect( m_compileScheduler, SIGNAL(compileRequested()), this, SLOT(onDirty()) );
+    connect( m_compileScheduler, SIGNAL(stateChanged()), this, SLOT(updateCompileQueueLabel()) );
 
     QDockWidget::DockWidgetFeatures dockFeatures =
         QDockWidget::DockWidgetMovable
@@ -272,23 +504,48 @@ MainWindow::MainWindow(
     m_timeLine = new Viewports::TimeLineWidget();
     m_timeLine->setTimeRange(TimeRange_Default_Frame_In, TimeRange_Default_Frame_Out);
     m_timeLine->updateTime(TimeRange_Default_Frame_In);
+    m_frameCacheBar = new FrameCacheBar( &m_frameCache, m_timeLine );
+    m_frameCacheBar->hide();
+    QWidget *timeLineWidget = new QWidget;
+    QVBoxLayout *timeLineLayout = new QVBoxLayout( timeLineWidget );
+    timeLineLayout->setContentsMargins( 0, 0, 0, 0 );
+    timeLineLayout->setSpacing( 0 );
+    timeLineLayout->addWidget( m_timeLine );
+    timeLineLayout->addWidget( m_frameCacheBar );
+
+    // the graph view, the value editor and the menus touch the binding
+    // from the UI thread; their input is held while the graph evaluates
+    ExecutorInputGate *inputGate = new ExecutorInputGate( m_executor, this );
+    inputGate->exempt( m_viewport );
+    inputGate->exempt( m_timeLine );
+    // the viewport draws the outputs of the binding; it keeps the last
+    // frame on screen meanwhile
+    inputGate->guardPaint( m_viewport );
+    QCoreApplication::instance()->installEventFilter( inputGate );
+    QObject::connect(m_preroller, SIGNAL(frameCached(int)), m_frameCacheBar, SLOT(update()));
     QDockWidget *timeLineDock = new QDockWidget("TimeLine", this);
     timeLineDock->setObjectName( "TimeLine" );
     timeLineDock->setFeatures( dockFeatures );
-    timeLineDock->setWidget(m_timeLine);
+    timeLineDock->setWidget(timeLineWidget);
     addDockWidget(Qt::BottomDockWidgetArea, timeLineDock, Qt::Vertical);
  
-    // [Julien] FE-5252
     // preset library
-    // Because of a lack of performances, we don't expose the search tool of the PresetTreeWidget
-    m_treeWidget = new DFG::PresetTreeWidget( m_dfgWidget->getDFGController(), config, true, false, true );
-    QDockWidget *treeDock = new QDockWidget("Explorer", this);
-    treeDock->setObjectName( "Explorer" );
-    treeDock->setFeatures( dockFeatures );
-    treeDock->setWidget(m_treeWidget);
-    addDockWidget(Qt::LeftDockWidgetArea, treeDock);
+    m_presetSearchWidget = new PresetSearchWidget( m_host );
+    m_treeDock = new QDockWidget("Explorer", this);
+    m_treeDock->setObjectName( "Explorer" );
+    m_treeDock->setFeatures( dockFeatures );
+    m_treeDock->setWidget( m_presetSearchWidget );
+    addDockWidget(Qt::LeftDockWidgetArea, m_treeDock);
+    QObject::connect(m_treeDock, SIGNAL(visibilityChanged(bool)), this, SLOT(flushPresetTreeRefresh()));
 
-    QObject::connect(m_dfgWidget, SIGNAL(newPresetSaved(QString)), m_treeWidget, SLOT(refresh()));
+    QObject::connect(
+      m_dfgWidget, SIGNAL(newPresetSaved(QString)),
+      m_presetSearchWidget, SLOT(onPresetSaved(QString))
+      );
+    QObject::connect(
+      m_presetSearchWidget, SIGNAL(presetActivated(QString)),
+      this, SLOT(onPresetActivated(QString))
+      );
 
     // value editor
     m_dfgValueEditor =
@@ -307,39 +564,52 @@ MainWindow::MainWindow(
     addDockWidget( Qt::RightDockWidgetArea, dfgValueEditorDockWidget );
 
     // log widget
-    m_logWidget = new DFG::DFGLogWidget;
-    QDockWidget *logDockWidget = new QDockWidget( "Log Messages", this );
-    logDockWidget->setObjectName( "Log" );
-    logDockWidget->setFeatures( dockFeatures );
-    logDockWidget->setWidget( m_logWidget );
-    logDockWidget->hide();
-    addDockWidget( Qt::TopDockWidgetArea, logDockWidget, Qt::Vertical );
+    m_logDock = new QDockWidget( "Log Messages", this );
+    m_logDock->setObjectName( "Log" );
+    m_logDock->setFeatures( dockFeatures );
+    m_logDock->hide();
+    addDockWidget( Qt::TopDockWidgetArea, m_logDock, Qt::Vertical );
 
     // History widget
-    m_qUndoView = new QUndoView( &m_qUndoStack );
-    m_qUndoView->setEmptyLabel( "New Graph" );
-    QDockWidget *undoDockWidget = new QDockWidget("History", this);
-    undoDockWidget->setObjectName( "History" );
-    undoDockWidget->setFeatures( dockFeatures );
-    undoDockWidget->setWidget(m_qUndoView);
-    undoDockWidget->hide();
-    addDockWidget(Qt::LeftDockWidgetArea, undoDockWidget);
+    m_undoDock = new QDockWidget("History", this);
+    m_undoDock->setObjectName( "History" );
+    m_undoDock->setFeatures( dockFeatures );
+    m_undoDock->hide();
+    addDockWidget(Qt::LeftDockWidgetArea, m_undoDock);
+
+    if ( m_lazyStartup )
+    {
+      QObject::connect(m_treeDock, SIGNAL(visibilityChanged(bool)), this, SLOT(createVisibleDockWidgets()));
+      QObject::connect(m_logDock, SIGNAL(visibilityChanged(bool)), this, SLOT(createVisibleDockWidgets()));
+      QObject::connect(m_undoDock, SIGNAL(visibilityChanged(bool)), this, SLOT(createVisibleDockWidgets()));
+    }
+    else
+    {
+      createPresetTreeWidget();
+      createLogWidget();
+      createUndoView();
+    }
+
+    // performance widget
+    m_performanceWidget = new PerformanceWidget;
+    QDockWidget *performanceDockWidget = new QDockWidget( "Performance", this );
+    performanceDockWidget->setObjectName( "Performance" );
+    performanceDockWidget->setFeatures( dockFeatures );
+    performanceDockWidget->setWidget( m_performanceWidget );
+    performanceDockWidget->hide();
+    addDockWidget( Qt::TopDockWidgetArea, performanceDockWidget, Qt::Vertical );
 
-    QObject::connect(
-      m_dfgWidget->getUIController(), SIGNAL(varsChanged()),
-      m_treeWidget, SLOT(refresh())
-      );
     QObject::connect(
       m_dfgWidget->getUIController(), SIGNAL(argsChanged()),
-      this, SLOT(onStructureChanged())
+      this, SLOT(onStructureNotified())
       );
     QObject::connect(
       m_dfgWidget->getUIController(), SIGNAL(argValuesChanged()),
-      this, SLOT(onValueChanged())
+      this, SLOT(onValuesNotified())
       );
     QObject::connect(
       m_dfgWidget->getUIController(), SIGNAL(defaultValuesChanged()),
-      this, SLOT(onValueChanged())
+      this, SLOT(onValuesNotified())
       );
     QObject::connect(
       m_dfgWidget, SIGNAL(nodeInspectRequested(FabricUI::GraphView::Node*)),
@@ -347,7 +617,7 @@ MainWindow::MainWindow(
       );
     QObject::connect(
       m_dfgWidget->getDFGController(), SIGNAL(dirty()),
-      this, SLOT(onDirty())
+      this, SLOT(onDirtyNotified())
       );
 
     QObject::connect(
@@ -365,11 +635,15 @@ MainWindow::MainWindow(
       );
 
     QObject::connect(m_timeLine, SIGNAL(frameChanged(int)), this, SLOT(onFrameChanged(int)));
+    QObject::connect(&m_qUndoStack, SIGNAL(indexChanged(int)), this, SLOT(invalidateFrameCache()));
+    QObject::connect(&m_qUndoStack, SIGNAL(indexChanged(int)), this, SLOT(onUndoIndexChanged()));
     // QObject::connect(m_manipAction, SIGNAL(triggered()), m_viewport, SLOT(toggleManipulation()));
 
     QObject::connect(m_dfgWidget, SIGNAL(onGraphSet(FabricUI::GraphView::Graph*)),
       this, SLOT(onGraphSet(FabricUI::GraphView::Graph*)));
 
+    markStartupPhase( "docks" );
+
     restoreGeometry( settings->value("mainWindow/geometry").toByteArray() );
     restoreState( settings->value("mainWindow/state").toByteArray() );
 
@@ -387,7 +661,7 @@ MainWindow::MainWindow(
     toggleAction = dfgDock->toggleViewAction();
     toggleAction->setShortcut( Qt::CTRL + Qt::Key_4 );
     windowMenu->addAction( toggleAction );
-    toggleAction = treeDock->toggleViewAction();
+    toggleAction = m_treeDock->toggleViewAction();
     toggleAction->setShortcut( Qt::CTRL + Qt::Key_5 );
     windowMenu->addAction( toggleAction );
     toggleAction = dfgValueEditorDockWidget->toggleViewAction();
@@ -397,16 +671,18 @@ MainWindow::MainWindow(
     toggleAction->setShortcut( Qt::CTRL + Qt::Key_9 );
     windowMenu->addAction( toggleAction );
     windowMenu->addSeparator();
-    toggleAction = undoDockWidget->toggleViewAction();
+    toggleAction = m_undoDock->toggleViewAction();
     toggleAction->setShortcut( Qt::CTRL + Qt::Key_7 );
     windowMenu->addAction( toggleAction );
-    toggleAction = logDockWidget->toggleViewAction();
+    toggleAction = m_logDock->toggleViewAction();
     toggleAction->setShortcut( Qt::CTRL + Qt::Key_8 );
     windowMenu->addAction( toggleAction );
+    windowMenu->addAction( performanceDockWidget->toggleViewAction() );
 
     onFrameChanged(m_timeLine->getTime());
     onGraphSet(m_dfgWidget->getUIGraph());
     onSidePanelInspectRequested();
+    markStartupPhase( "menus" );
   }
   catch(FabricCore::Exception e)
   {
@@ -416,6 +692,357 @@ MainWindow::MainWindow(
   installEventFilter(new MainWindowEventFilter(this));
 }
 
+void MainWindow::markStartupPhase( char const *phase )
+{
+  if ( m_startupProfiler )
+    m_startupProfiler->mark( phase );
+}
+
+void MainWindow::onStartupFinished()
+{
+  if ( m_startupFinished )
+    return;
+  m_startupFinished = true;
+
+  if ( m_startupProfiler )
+  {
+    m_startupProfiler->mark( "firstFrame" );
+    m_startupProfiler->print();
+  }
+
+  createVisibleDockWidgets();
+  startDeferredExtensionLoad();
+
+  if ( m_settings->value( "codeCompletion/indexExtensions", true ).toBool() )
+    m_extensionIndexer->start();
+}
+
+void MainWindow::onExtensionIndexFinished(
+  unsigned parsedCount,
+  unsigned failedCount
+  )
+{
+  QString message =
+    QString( "Parsed %1 extension(s) for code completion" ).arg( parsedCount );
+  if ( failedCount > 0 )
+    message += QString( ", %1 could not be parsed" ).arg( failedCount );
+  log( message.toUtf8().constData() );
+}
+
+void MainWindow::createVisibleDockWidgets()
+{
+  if ( !m_startupFinished )
+    return;
+
+  if ( !m_treeWidget && m_treeDock->isVisible() )
+    createPresetTreeWidget();
+  if ( !m_logWidget && m_logDock->isVisible() )
+    createLogWidget();
+  if ( !m_qUndoView && m_undoDock->isVisible() )
+    createUndoView();
+}
+
+void MainWindow::createPresetTreeWidget()
+{
+  CANVAS_TRACE_SCOPE( "createPresetTreeWidget" );
+
+  // [Julien] FE-5252
+  // The search tool of the PresetTreeWidget is too slow on large
+  // libraries; the PresetSearchWidget above the tree replaces it
+  DFG::DFGConfig config;
+  m_treeWidget = new DFG::PresetTreeWidget( m_dfgWidget->getDFGController(), config, true, false, true );
+  m_presetSearchWidget->setBrowser( m_treeWidget );
+  m_presetTreeRefreshPending = false;
+
+  // in lazy startup mode, the library is only walked once the Explorer
+  // is shown
+  m_presetSearchWidget->rebuild();
+
+  QObject::connect(m_dfgWidget, SIGNAL(newPresetSaved(QString)), this, SLOT(schedulePresetTreeRefresh()));
+  QObject::connect(
+    m_dfgWidget->getUIController(), SIGNAL(varsChanged()),
+    this, SLOT(schedulePresetTreeRefresh())
+    );
+}
+
+void MainWindow::schedulePresetTreeRefresh()
+{
+  // a burst of notifications leads to a single refresh at the end of
+  // the delay, rather than one per notification
+  m_presetTreeRefreshPending = true;
+  if ( !m_presetTreeRefreshTimer.isActive() )
+    m_presetTreeRefreshTimer.start();
+}
+
+void MainWindow::flushPresetTreeRefresh()
+{
+  // while the dock is hidden, the refresh waits for it to be shown
+  if ( !m_presetTreeRefreshPending
+    || !m_treeWidget
+    || !m_treeDock->isVisible() )
+    return;
+  m_presetTreeRefreshPending = false;
+  m_presetTreeRefreshTimer.stop();
+
+  CANVAS_TRACE_SCOPE( "refreshPresetTree" );
+  m_treeWidget->refresh();
+}
+
+void MainWindow::onPresetActivated( QString presetPath )
+{
+  // drop the node in the middle of the visible part of the graph
+  GraphView::GraphViewWidget *graphViewWidget =
+    m_dfgWidget->getGraphViewWidget();
+  QPointF scenePos = graphViewWidget->mapToScene(
+    graphViewWidget->viewport()->rect().center()
+    );
+  QPointF graphPos =
+    m_dfgWidget->getUIGraph()->itemGroup()->mapFromScene( scenePos );
+
+  m_dfgWidget->getUIController()->cmdAddInstFromPreset(
+    presetPath.toUtf8().constData(),
+    graphPos
+    );
+}
+
+void MainWindow::createLogWidget()
+{
+  std::vector<PendingLogMessage> pendingLogMessages;
+  unsigned droppedLogMessageCount;
+  {
+    QMutexLocker locker( &m_logMutex );
+    m_logWidget = new DFG::DFGLogWidget;
+    pendingLogMessages.swap( m_pendingLogMessages );
+    droppedLogMessageCount = m_droppedLogMessageCount;
+    m_droppedLogMessageCount = 0;
+  }
+  m_logDock->setWidget( m_logWidget );
+
+  for ( size_t i = 0; i < pendingLogMessages.size(); ++i )
+  {
+    PendingLogMessage const &message = pendingLogMessages[i];
+    if ( message.fromCore )
+      DFG::DFGLogWidget::callback(
+        NULL,
+        message.source,
+        message.level,
+        message.text.c_str(),
+        uint32_t( message.text.size() )
+        );
+    else if ( message.level == FEC_ReportLevel_Error )
+      m_dfgWidget->getUIController()->logError( message.text.c_str() );
+    else
+      m_dfgWidget->getUIController()->log( message.text.c_str() );
+  }
+  if ( droppedLogMessageCount > 0 )
+    log(
+      QString( "%1 earlier message(s) were not kept" )
+        .arg( droppedLogMessageCount ).toUtf8().constData()
+      );
+}
+
+void MainWindow::LogCallback(
+  void *userdata,
+  FEC_ReportSource source,
+  FEC_ReportLevel level,
+  char const *data,
+  uint32_t size
+  )
+{
+  DFG::DFGLogWidget::callback( NULL, source, level, data, size );
+
+  MainWindow *mainWindow = static_cast<MainWindow *>( userdata );
+  PendingLogMessage message;
+  message.fromCore = true;
+  message.source = source;
+  message.level = level;
+  message.text.assign( data, size );
+  mainWindow->keepLogMessage( message );
+}
+
+void MainWindow::log( char const *message )
+{
+  // the graph view does not exist yet while the client is created
+  if ( m_dfgWidget )
+    m_dfgWidget->getUIController()->log( message );
+
+  PendingLogMessage pendingMessage;
+  pendingMessage.fromCore = false;
+  pendingMessage.source = FEC_ReportSource_User;
+  pendingMessage.level = FEC_ReportLevel_Info;
+  pendingMessage.text = message;
+  keepLogMessage( pendingMessage );
+}
+
+void MainWindow::logError( char const *message )
+{
+  if ( m_dfgWidget )
+    m_dfgWidget->getUIController()->logError( message );
+
+  PendingLogMessage pendingMessage;
+  pendingMessage.fromCore = false;
+  pendingMessage.source = FEC_ReportSource_User;
+  pendingMessage.level = FEC_ReportLevel_Error;
+  pendingMessage.text = message;
+  keepLogMessage( pendingMessage );
+}
+
+void MainWindow::keepLogMessage( PendingLogMessage const &message )
+{
+  QMutexLocker locker( &m_logMutex );
+  if ( m_logWidget )
+    return;
+  if ( m_pendingLogMessages.size() >= 1000 )
+    ++m_droppedLogMessageCount;
+  else
+    m_pendingLogMessages.push_back( message );
+}
+
+void MainWindow::createUndoView()
+{
+  m_qUndoView = new QUndoView( &m_qUndoStack );
+  m_qUndoView->setEmptyLabel( m_undoEmptyLabel );
+
+  m_undoBudgetLabel = new QLabel;
+  m_undoBudgetLabel->setToolTip( "Estimated memory held by the undo history" );
+
+  QWidget *undoWidget = new QWidget;
+  QVBoxLayout *undoLayout = new QVBoxLayout( undoWidget );
+  undoLayout->setContentsMargins( 0, 0, 0, 0 );
+  undoLayout->addWidget( m_qUndoView, 1 );
+  undoLayout->addWidget( m_undoBudgetLabel );
+  m_undoDock->setWidget( undoWidget );
+
+  updateUndoBudgetLabel();
+}
+
+void MainWindow::updateUndoBudgetLabel()
+{
+  if ( !m_undoBudgetLabel )
+    return;
+
+  uint64_t usedBytes = m_dfguiCommandHandler.usedBytes();
+  double usedMB = double( usedBytes ) / double( 1 << 20 );
+  uint64_t budgetBytes = m_dfguiCommandHandler.budget();
+  // the history is cleared as a whole once over budget; say so before
+  bool nearBudget = budgetBytes > 0 && usedBytes >= budgetBytes / 5 * 4;
+  m_undoBudgetLabel->setStyleSheet( nearBudget? "color: #e0a030;": "" );
+  if ( nearBudget )
+    m_undoBudgetLabel->setText(
+      QString( "Undo memory: %1 of %2 MB; the history will be cleared when full" )
+        .arg( usedMB, 0, 'f', 1 )
+        .arg( budgetBytes >> 20 )
+      );
+  else if ( budgetBytes > 0 )
+    m_undoBudgetLabel->setText(
+      QString( "Undo memory: %1 of %2 MB" )
+        .arg( usedMB, 0, 'f', 1 )
+        .arg( budgetBytes >> 20 )
+      );
+  else
+    m_undoBudgetLabel->setText(
+      QString( "Undo memory: %1 MB" ).arg( usedMB, 0, 'f', 1 )
+      );
+}
+
+void MainWindow::onUndoIndexChanged()
+{
+  updateUndoBudgetLabel();
+
+  // not from within the push, nor while a macro is open
+  if ( !m_undoTrimPending && m_dfguiCommandHandler.isOverBudget() )
+  {
+    m_undoTrimPending = true;
+    QTimer::singleShot( 0, this, SLOT(trimUndoHistory()) );
+  }
+}
+
+void MainWindow::trimUndoHistory()
+{
+  m_undoTrimPending = false;
+  if ( !m_dfguiCommandHandler.isOverBudget() )
+    return;
+
+  // the core keeps its own undo entries, which it can only drop all
+  // at once
+  QString message =
+    QString( "The undo history exceeded its budget of %1 MB and was cleared." )
+      .arg( m_dfguiCommandHandler.budget() >> 20 );
+  log( message.toUtf8().constData() );
+
+  m_host.flushUndoRedo();
+  m_qUndoStack.clear();
+  setUndoEmptyLabel(
+    QString( "History Cleared (over %1 MB)" )
+      .arg( m_dfguiCommandHandler.budget() >> 20 )
+    );
+}
+
+void MainWindow::setUndoEmptyLabel( QString const &label )
+{
+  m_undoEmptyLabel = label;
+  if ( m_qUndoView )
+    m_qUndoView->setEmptyLabel( label );
+}
+
+void MainWindow::clearLog()
+{
+  if ( m_logWidget )
+    m_logWidget->clear();
+  else
+  {
+    QMutexLocker locker( &m_logMutex );
+    m_pendingLogMessages.clear();
+    m_droppedLogMessageCount = 0;
+  }
+}
+
+void MainWindow::startDeferredExtensionLoad()
+{
+  // loaded on the UI thread once the first frame is on screen: the client
+  // is used by the UI and cannot load an extension from another thread
+  // meanwhile
+  if ( !m_deferredExtensions.isEmpty() )
+    QTimer::singleShot( 0, this, SLOT(loadDeferredExtensions()) );
+}
+
+void MainWindow::loadDeferredExtensions()
+{
+  // a graph may be loaded before the first frame: load them right away
+  if ( m_deferredExtensions.isEmpty() )
+    return;
+  QStringList names = m_deferredExtensions;
+  m_deferredExtensions.clear();
+  loadExtensions( names );
+}
+
+void MainWindow::loadExtensions( QStringList names )
+{
+  CANVAS_TRACE_SCOPE( "loadExtensions" );
+
+  QElapsedTimer timer;
+  timer.start();
+
+  for ( int i = 0; i < names.size(); ++i )
+  {
+    try
+    {
+      m_client.loadExtension( names[i].toUtf8().constData(), "", false );
+    }
+    catch ( FabricCore::Exception e )
+    {
+      printf("Exception: %s\n", e.getDesc_cstr());
+    }
+  }
+
+  if ( m_startupProfiler )
+    printf(
+      "Loaded %s in %.1f ms\n",
+      names.join( ", " ).toUtf8().constData(),
+      double( timer.nsecsElapsed() ) / 1.0e6
+      );
+}
+
 void MainWindow::closeEvent( QCloseEvent *event )
 {
   if(!checkUnsavedChanged())
@@ -432,8 +1059,14 @@ void MainWindow::closeEvent( QCloseEvent *event )
 
 bool MainWindow::checkUnsavedChanged()
 {
+  // the previous graph has been released, and the one being read has
+  // no changes yet
+  if ( m_graphLoadStage == GraphLoadStage_Parsing )
+    return true;
+
   FabricCore::DFGBinding binding = m_dfgWidget->getUIController()->getBinding();
-  if ( binding.getVersion() != m_lastSavedBindingVersion )
+  if ( m_isUnsavedRecovery
+    || binding.getVersion() != m_lastSavedBindingVersion )
   {
     QMessageBox msgBox;
     msgBox.setText( "Do you want to save your changes?" );
@@ -456,10 +1089,16 @@ bool MainWindow::checkUnsavedChanged()
 
 MainWindow::~MainWindow()
 {
+  if ( m_graphLoader )
+    m_graphLoader->waitForFinished();
+  m_executor->cancel();
+  m_executor->waitForIdle();
+  m_preroller->release();
+  m_extensionIndexer->stop();
   if(m_manager)
     delete(m_manager);
 
-  FTL::FSMaybeDeleteFile( m_autosaveFilename );
+  m_autosaveWriter->removeFiles();
 }
 
 void MainWindow::onHotkeyPressed(Qt::Key key, Qt::KeyboardModifier modifiers, QString hotkey)
@@ -486,112 +1125,467 @@ void MainWindow::onHotkeyPressed(Qt::Key key, Qt::KeyboardModifier modifiers, QS
     if( m_manipAction )
       m_manipAction->trigger();
   }
-  else
+  else
+  {
+    m_dfgWidget->onHotkeyPressed(key, modifiers, hotkey);
+  }
+}
+
+void MainWindow::onFrameChanged(int frame)
+{
+  CANVAS_TRACE_SCOPE( "onFrameChanged" );
+
+  // there is no binding to set the frame on until the graph is read
+  if ( m_graphLoadStage == GraphLoadStage_Parsing )
+    return;
+
+  try
+  {
+    m_evalContextTime.setFloat32( float( frame ) );
+    m_executor->setMember(
+      m_evalContext,
+      "time",
+      m_evalContextTime
+      );
+  }
+  catch(FabricCore::Exception e)
+  {
+    logError(e.getDesc_cstr());
+  }
+
+  applyPortDrivers( frame );
+
+  if ( !m_timelinePort.isSet() )
+    return;
+
+  try
+  {
+    m_executor->setArgValue(
+      m_dfgWidget->getUIController()->getBinding(),
+      unsigned( m_timelinePort.index() ),
+      m_timelinePort.frameValue( m_client, frame )
+      );
+  }
+  catch(FabricCore::Exception e)
+  {
+    logError(e.getDesc_cstr());
+  }
+
+  if ( restoreFrameFromCache( frame ) )
+  {
+    // the outputs are already known: skip the evaluation
+    if ( m_pendingUpdates & PendingUpdate_Dirty )
+    {
+      m_pendingUpdates &= ~PendingUpdate_Dirty;
+      ++m_avoidedEvaluationCount;
+    }
+    schedulePendingUpdate( PendingUpdate_Values );
+    emit contentChanged();
+  }
+
+  // evaluate the next frames while this one is on screen; simulations
+  // depend on the previous frame and cannot be evaluated ahead, and the
+  // frames of drawing graphs are never restored from the cache
+  if ( m_frameCacheEnabled && !m_timeLine->simulationMode()
+    && !m_portDrivers.dependsOnView() && !m_graphDrawsInline )
+    m_preroller->request(
+      m_timelinePort,
+      frame,
+      int( m_timeLine->getRangeStart() ),
+      int( m_timeLine->getRangeEnd() ),
+      m_timeLine->loopMode() == 1
+      );
+}
+
+void MainWindow::applyPortDrivers( int frame )
+{
+  if ( !m_portDrivers.hasBoundPorts() )
+    return;
+
+  PortDriverInputs inputs;
+  inputs.fps = m_timeLine->framerate();
+  if ( inputs.fps <= 0.0 )
+    inputs.fps = 24.0;
+  // a jump backwards, such as a loop, counts as a single frame
+  int frameDelta = frame - m_lastDrivenFrame;
+  inputs.deltaTime = double( frameDelta > 0? frameDelta: 1 ) / inputs.fps;
+  m_lastDrivenFrame = frame;
+  inputs.viewportWidth = m_viewport->width();
+  inputs.viewportHeight = m_viewport->height();
+
+  try
+  {
+    inputs.camera = m_viewport->getCamera();
+    // frames evaluated with other driver values cannot be reused
+    if ( m_portDrivers.apply(
+      m_client,
+      *m_executor,
+      m_dfgWidget->getUIController()->getBinding(),
+      inputs
+      ) )
+      invalidateFrameCache();
+  }
+  catch(FabricCore::Exception e)
+  {
+    logError(e.getDesc_cstr());
+  }
+}
+
+bool MainWindow::restoreFrameFromCache( int frame )
+{
+  // simulations depend on the previous frame, so they are never cached;
+  // nor are graphs driven by the view, which changes outside the timeline
+  if ( !m_frameCacheEnabled || m_timeLine->simulationMode()
+    || m_portDrivers.dependsOnView() )
+    return false;
+
+  // the viewport would keep drawing the last evaluated frame
+  if ( m_graphDrawsInline )
+    return false;
+
+  std::vector<FrameCacheValue> const *values =
+    m_frameCache.lookup( m_editGeneration, frame );
+  if ( !values )
+    return false;
+
+  try
+  {
+    FabricCore::DFGBinding binding =
+      m_dfgWidget->getUIController()->getBinding();
+    for ( size_t i = 0; i < values->size(); ++i )
+      m_executor->setArgValue(
+        binding,
+        (*values)[i].portName.c_str(),
+        (*values)[i].value
+        );
+  }
+  catch(FabricCore::Exception e)
+  {
+    logError(e.getDesc_cstr());
+    return false;
+  }
+  return true;
+}
+
+void MainWindow::storeFrameInCache( int frame )
+{
+  if ( !m_frameCacheEnabled || m_timeLine->simulationMode()
+    || m_portDrivers.dependsOnView() || m_graphDrawsInline )
+    return;
+
+  try
+  {
+    FabricCore::DFGBinding binding =
+      m_dfgWidget->getUIController()->getBinding();
+    std::vector<FrameCacheValue> values;
+    if ( !CopyFrameOutputs( m_client, binding, values ) )
+      return;
+
+    m_frameCache.insert( m_editGeneration, frame, values );
+    m_frameCacheBar->update();
+  }
+  catch(FabricCore::Exception e)
+  {
+    logError(e.getDesc_cstr());
+  }
+}
+
+void MainWindow::invalidateFrameCache()
+{
+  // entries of older generations can never be hit again
+  m_frameCache.clear();
+  ++m_editGeneration;
+  if ( m_preroller )
+    m_preroller->invalidate( m_editGeneration );
+  if ( m_frameCacheBar )
+    m_frameCacheBar->setVersion( m_editGeneration );
+}
+
+void MainWindow::setFrameCacheEnabled( bool enabled )
+{
+  m_frameCacheEnabled = enabled;
+  if ( !enabled )
+  {
+    m_preroller->release();
+    m_frameCache.clear();
+  }
+  m_frameCacheBar->setVisible( enabled );
+  m_frameCacheBar->update();
+}
+
+void MainWindow::setTraceRecording( bool recording )
+{
+  if ( recording )
+  {
+    TraceRecorder::Start();
+    return;
+  }
+
+  if ( !TraceRecorder::IsRecording() )
+    return;
+
+  QString lastPresetFolder = m_settings->value("mainWindow/lastPresetFolder").toString();
+  QString filePath = QFileDialog::getSaveFileName(this, "Save trace", lastPresetFolder, "*.json");
+  if ( filePath.length() > 0 && !filePath.toLower().endsWith(".json") )
+    filePath += ".json";
+
+  // an empty path discards the recording
+  if ( !TraceRecorder::Stop( filePath.toUtf8().constData() ) )
+  {
+    QString message = "Unable to write trace to '" + filePath + "'.";
+    logError( message.toUtf8().constData() );
+  }
+  else if ( filePath.length() > 0 )
   {
-    m_dfgWidget->onHotkeyPressed(key, modifiers, hotkey);
+    QString message = "Trace written to '" + filePath + "'.";
+    log( message.toUtf8().constData() );
   }
 }
 
-void MainWindow::onFrameChanged(int frame)
+void MainWindow::setManipulationGroup(
+  QString const &portName,
+  QStringList const &groupPortNames
+  )
+{
+  if ( groupPortNames.isEmpty() )
+    m_manipulationSession->removeGroup( portName );
+  else
+    m_manipulationSession->setGroup( portName, groupPortNames );
+}
+
+void MainWindow::onPortManipulationRequested(QString portName)
 {
+  // the values set while dragging are not in the undo history
+  invalidateFrameCache();
+
   try
   {
-    m_evalContext.setMember("time", FabricCore::RTVal::ConstructFloat32(m_client, frame));
+    m_manipulationSession->update(
+      portName,
+      m_viewport->getManipTool()->getLastManipVal()
+      );
   }
   catch(FabricCore::Exception e)
   {
-    m_dfgWidget->getUIController()->logError(e.getDesc_cstr());
+    logError(e.getDesc_cstr());
   }
+}
 
-  if ( m_timelinePortIndex == -1 )
+void MainWindow::onDirty()
+{
+  // a graph being loaded is evaluated once its arguments are bound;
+  // bindLoadedGraph() requests that evaluation
+  if ( m_graphLoadStage == GraphLoadStage_Parsing
+    || m_graphLoadStage == GraphLoadStage_Binding )
     return;
 
-  try
+  CANVAS_TRACE_SCOPE( "onDirty" );
+
+  m_executor->requestExecute(
+    m_dfgWidget->getUIController()->getBinding(),
+    m_timeLine->getTime(),
+    m_editGeneration
+    );
+}
+
+void MainWindow::onExecuted(
+  double elapsedMS,
+  int frame,
+  unsigned generation
+  )
+{
+  CANVAS_TRACE_SCOPE( "onExecuted" );
+
+  m_performanceSample.executeMS += elapsedMS;
+  ++m_performanceSample.evaluationCount;
+
+  if ( m_frameCacheEnabled )
   {
-    FabricCore::DFGBinding binding =
-      m_dfgWidget->getUIController()->getBinding();
-    FabricCore::DFGExec exec = binding.getExec();
-    if ( exec.isExecPortResolvedType( m_timelinePortIndex, "SInt32" ) )
-      binding.setArgValue(
-        m_timelinePortIndex,
-        FabricCore::RTVal::ConstructSInt32( m_client, frame ),
-        false
-        );
-    else if ( exec.isExecPortResolvedType( m_timelinePortIndex, "UInt32" ) )
-      binding.setArgValue(
-        m_timelinePortIndex,
-        FabricCore::RTVal::ConstructUInt32( m_client, frame ),
-        false
-        );
-    else if ( exec.isExecPortResolvedType( m_timelinePortIndex, "Float32" ) )
-      binding.setArgValue(
-        m_timelinePortIndex,
-        FabricCore::RTVal::ConstructFloat32( m_client, frame ),
-        false
-        );
-    else if ( exec.isExecPortResolvedType( m_timelinePortIndex, "Float64" ) )
-      binding.setArgValue(
-        m_timelinePortIndex,
-        FabricCore::RTVal::ConstructFloat64( m_client, frame ),
-        false
+    bool graphDrawsInline = HasInlineDrawing( m_client );
+    if ( graphDrawsInline != m_graphDrawsInline )
+    {
+      m_graphDrawsInline = graphDrawsInline;
+      m_frameCacheBar->setCacheable( !graphDrawsInline );
+      if ( graphDrawsInline )
+        log( "Playback frames are not cached: the graph draws in the viewport" );
+    }
+  }
+
+  // results computed before the latest edit are not worth keeping
+  if ( generation == m_editGeneration )
+  {
+    storeFrameInCache( frame );
+
+    // the binding is idle until it is released: copy it for the look-ahead
+    if ( m_frameCacheEnabled && m_preroller->isWaitingForGraph() )
+      m_preroller->setGraph(
+        m_host,
+        m_dfgWidget->getUIController()->getBinding()
         );
   }
-  catch(FabricCore::Exception e)
+
+  onValueChanged();
+
+  if ( m_graphLoadStage == GraphLoadStage_Evaluating )
   {
-    m_dfgWidget->getUIController()->logError(e.getDesc_cstr());
+    QString message =
+      QString( "Graph ready in %1 s" )
+        .arg( double( m_graphLoadTimer.nsecsElapsed() ) / 1.0e9, 0, 'f', 3 );
+    log( message.toUtf8().constData() );
+    setGraphLoadStage( GraphLoadStage_Idle );
   }
+
+  emit contentChanged();
+
+  // the outputs have been read and drawn
+  m_executor->release();
 }
 
-void MainWindow::onPortManipulationRequested(QString portName)
+void MainWindow::onExecutionFailed( QString message )
 {
-  try
+  logError( message.toUtf8().constData() );
+
+  if ( m_graphLoadStage == GraphLoadStage_Evaluating )
+    setGraphLoadStage( GraphLoadStage_Idle );
+
+  emit contentChanged();
+
+  m_executor->release();
+}
+
+void MainWindow::onSlowOperationPushed( QString description )
+{
+  if ( m_slowOperationDepth++ == 0 )
   {
-    DFG::DFGController * controller = m_dfgWidget->getUIController();
-    FabricCore::DFGBinding &binding = controller->getBinding();
-    FabricCore::DFGExec exec = binding.getExec();
-    FTL::StrRef portResolvedType = exec.getExecPortResolvedType(portName.toUtf8().constData());
-    FabricCore::RTVal value = m_viewport->getManipTool()->getLastManipVal();
-    if(portResolvedType == "Xfo")
-    {
-      // pass
-    }
-    else if(portResolvedType == "Mat44")
-      value = value.callMethod("Mat44", "toMat44", 0, 0);
-    else if(portResolvedType == "Vec3")
-      value = value.maybeGetMember("tr");
-    else if(portResolvedType == "Quat")
-      value = value.maybeGetMember("ori");
-    else
-    {
-      QString message = "Port '"+portName;
-      message += "'to be driven has unsupported type '";
-      message += portResolvedType.data();
-      message += "'.";
-      m_dfgWidget->getUIController()->logError(message.toUtf8().constData());
-      return;
-    }
-    controller->cmdSetArgValue(
-      portName.toUtf8().constData(),
-      value
-      );
+    m_slowOperationElapsedTimer.start();
+    m_slowOperationCancelButton->setEnabled( true );
+    m_slowOperationTimer->start();
+    m_slowOperationRefreshTimer->start();
   }
-  catch(FabricCore::Exception e)
+  m_slowOperationDescriptions.append( description );
+  updateSlowOperationLabel();
+}
+
+void MainWindow::onSlowOperationPopped()
+{
+  if ( m_slowOperationDepth == 0 )
+    return;
+
+  if ( !m_slowOperationDescriptions.isEmpty() )
+    m_slowOperationDescriptions.removeLast();
+
+  if ( --m_slowOperationDepth == 0 )
   {
-    m_dfgWidget->getUIController()->logError(e.getDesc_cstr());
+    m_slowOperationTimer->stop();
+    m_slowOperationRefreshTimer->stop();
+    m_slowOperationDialog->hide();
   }
+  else
+    updateSlowOperationLabel();
 }
 
-void MainWindow::onDirty()
+void MainWindow::updateSlowOperationLabel()
 {
-  m_dfgWidget->getUIController()->execute();
+  if ( m_slowOperationDepth == 0 )
+    return;
 
-  onValueChanged();
+  // one line per nesting level, innermost last
+  QString text;
+  for ( int i = 0; i < m_slowOperationDescriptions.size(); ++i )
+  {
+    if ( i > 0 )
+      text += "\n";
+    for ( int j = 0; j < i; ++j )
+      text += "    ";
+    text += m_slowOperationDescriptions.at( i );
+  }
+  text += QString( "\n\nElapsed: %1 s" )
+    .arg( double( m_slowOperationElapsedTimer.elapsed() ) / 1000.0, 0, 'f', 1 );
+  if ( !m_slowOperationCancelButton->isEnabled() )
+    text += " (cancelling)";
+  m_slowOperationLabel->setText( text );
+}
 
-  emit contentChanged();
+void MainWindow::cancelSlowOperation()
+{
+  // the core cannot interrupt a running evaluation: the pending request
+  // and the result of the running one are dropped, and playback stops
+  // so that no further frames are requested
+  m_timeLine->pause();
+  m_executor->cancel();
+  m_pendingUpdates &= ~PendingUpdate_Dirty;
+  m_slowOperationCancelButton->setEnabled( false );
+  updateSlowOperationLabel();
+}
+
+void MainWindow::schedulePendingUpdate( PendingUpdate update )
+{
+  m_pendingUpdates |= update;
+  if ( !m_pendingUpdatesTimer.isActive() )
+    m_pendingUpdatesTimer.start();
+}
+
+void MainWindow::onDirtyNotified()
+{
+  if ( m_pendingUpdates & PendingUpdate_Dirty )
+    ++m_avoidedEvaluationCount;
+  schedulePendingUpdate( PendingUpdate_Dirty );
+}
+
+void MainWindow::onValuesNotified()
+{
+  schedulePendingUpdate( PendingUpdate_Values );
+}
+
+void MainWindow::onStructureNotified()
+{
+  // a graph being loaded is compiled by its first evaluation
+  if ( m_graphLoadStage == GraphLoadStage_Idle )
+    m_compileScheduler->onEdited();
+  schedulePendingUpdate( PendingUpdate_Structure );
+}
+
+void MainWindow::updateCompileQueueLabel()
+{
+  switch ( m_compileScheduler->state() )
+  {
+    case CompileScheduler::State_Idle:
+      m_compileQueueLabel->clear();
+      break;
+    case CompileScheduler::State_Deferred:
+      m_compileQueueLabel->setText(
+        QString( "Compilation deferred (%1 edits)" )
+          .arg( m_compileScheduler->deferredEditCount() )
+        );
+      break;
+    case CompileScheduler::State_Compiling:
+      m_compileQueueLabel->setText( "Compiling..." );
+      break;
+  }
+}
+
+void MainWindow::flushPendingUpdates()
+{
+  unsigned pendingUpdates = m_pendingUpdates;
+  m_pendingUpdates = 0;
+
+  if ( pendingUpdates & PendingUpdate_Structure )
+    onStructureChanged();
+
+  // the outputs are refreshed once the evaluation completes
+  if ( pendingUpdates & PendingUpdate_Dirty )
+    onDirty();
+  // the outputs cannot be read while an evaluation runs; onExecuted()
+  // refreshes them once it has completed
+  else if ( ( pendingUpdates & PendingUpdate_Values )
+    && !m_executor->isBusy() )
+    onValueChanged();
 }
 
 void MainWindow::onValueChanged()
 {
+  CANVAS_TRACE_SCOPE( "onValueChanged" );
+
   try
   {
     // FabricCore::DFGExec graph = m_dfgWidget->getUIController()->getGraph();
@@ -601,47 +1595,75 @@ void MainWindow::onValueChanged()
     //   if(ports[i]->getPortType() == FabricCore::DFGPortType_Out)
     //     continue;
     //   FabricCore::RTVal argVal = graph.getWrappedCoreBinding().getArgValue(ports[i]->getName());
-    //   m_dfgWidget->getUIController()->log(argVal.getJSON().getStringCString());
+    //   log(argVal.getJSON().getStringCString());
     // }
+    QElapsedTimer updateOutputsTimer;
+    updateOutputsTimer.start();
     m_dfgValueEditor->updateOutputs();
+    m_performanceSample.updateOutputsMS +=
+      double( updateOutputsTimer.nsecsElapsed() ) / 1.0e6;
   }
   catch(FabricCore::Exception e)
   {
-    m_dfgWidget->getUIController()->logError(e.getDesc_cstr());
+    logError(e.getDesc_cstr());
   }
 }
 
 void MainWindow::onStructureChanged()
 {
+  CANVAS_TRACE_SCOPE( "onStructureChanged" );
+
+  invalidateFrameCache();
+  m_manipulationSession->invalidateConversions();
+
   if(m_dfgWidget->getUIController()->isViewingRootGraph())
   {
-    m_timelinePortIndex = -1;
+    m_timelinePort.reset();
+    m_portDrivers.reset();
     try
     {
+      // resolved once per batch of structure changes, so that
+      // onFrameChanged() does no lookup; the root port map is kept up to
+      // date by the command handler, and only rebuilt when it is stale
       FabricCore::DFGExec graph =
         m_dfgWidget->getUIController()->getExec();
-      unsigned portCount = graph.getExecPortCount();
-      for(unsigned i=0;i<portCount;i++)
-      {
-        if ( graph.getExecPortType(i) == FabricCore::DFGPortType_Out )
-          continue;
-        FTL::CStrRef portName = graph.getExecPortName( i );
-        if ( portName != FTL_STR("timeline") )
-          continue;
-        if ( !graph.isExecPortResolvedType( i, "SInt32" )
-          && !graph.isExecPortResolvedType( i, "UInt32" )
-          && !graph.isExecPortResolvedType( i, "Float32" )
-          && !graph.isExecPortResolvedType( i, "Float64" ) )
-          continue;
-        m_timelinePortIndex = int( i );
-        break;
-      }
+      m_timelinePort.resolve( graph, m_rootPorts );
+      m_portDrivers.resolve( graph, m_rootPorts );
+    }
+    catch(FabricCore::Exception e)
+    {
+      logError(e.getDesc_cstr());
+    }
+
+    // newly bound ports get their value without waiting for a frame change
+    applyPortDrivers( m_timeLine->getTime() );
+  }
+}
+
+void MainWindow::onContentChanged()
+{
+  CANVAS_TRACE_SCOPE( "redraw" );
+
+  QElapsedTimer redrawTimer;
+  redrawTimer.start();
+  m_viewport->redraw();
+  m_performanceSample.redrawMS = double( redrawTimer.nsecsElapsed() ) / 1.0e6;
+
+  if ( m_performanceWidget )
+  {
+    m_performanceSample.frame = m_timeLine? m_timeLine->getTime(): 0;
+    try
+    {
+      m_performanceSample.bindingVersion =
+        m_dfgWidget->getUIController()->getBinding().getVersion();
     }
     catch(FabricCore::Exception e)
     {
-      m_dfgWidget->getUIController()->logError(e.getDesc_cstr());
+      m_performanceSample.bindingVersion = 0;
     }
+    m_performanceWidget->addSample( m_performanceSample );
   }
+  m_performanceSample = PerformanceSample();
 }
 
 void MainWindow::updateFPS()
@@ -653,6 +1675,10 @@ void MainWindow::updateFPS()
   caption.setNum(m_viewport->fps(), 'f', 2);
   caption += " FPS";
   m_fpsLabel->setText( caption );
+
+  caption.setNum( m_avoidedEvaluationCount );
+  caption += " evals merged";
+  m_avoidedEvaluationsLabel->setText( caption );
 }
 
 void MainWindow::onGraphSet(FabricUI::GraphView::Graph * graph)
@@ -740,6 +1766,9 @@ void MainWindow::onNewGraph()
   if(!checkUnsavedChanged())
     return;
 
+  cancelGraphLoad();
+  m_compileScheduler->reset();
+
   m_lastFileName = "";
   // m_saveGraphAction->setEnabled(false);
 
@@ -748,6 +1777,13 @@ void MainWindow::onNewGraph()
     FabricUI::DFG::DFGController *dfgController =
       m_dfgWidget->getUIController();
 
+    // the running evaluation and autosave must not outlive the binding
+    m_manipulationSession->discard();
+    m_executor->cancel();
+    m_executor->waitForIdle();
+    m_preroller->release();
+    m_autosaveWriter->waitForFinished();
+
     FabricCore::DFGBinding binding = dfgController->getBinding();
     binding.deallocValues();
 
@@ -755,6 +1791,7 @@ void MainWindow::onNewGraph()
 
     m_host.flushUndoRedo();
     m_qUndoStack.clear();
+    invalidateFrameCache();
     m_viewport->clearInlineDrawing();
     QCoreApplication::processEvents();
 
@@ -763,8 +1800,11 @@ void MainWindow::onNewGraph()
 
     binding = m_host.createBindingToNewGraph();
     m_lastSavedBindingVersion = binding.getVersion();
+    m_isUnsavedRecovery = false;
     FabricCore::DFGExec exec = binding.getExec();
-    m_timelinePortIndex = -1;
+    m_timelinePort.reset();
+    m_rootPorts.clear();
+    m_portDrivers.reset();
 
     dfgController->setBindingExec( binding, FTL::StrRef(), exec );
 
@@ -774,7 +1814,7 @@ void MainWindow::onNewGraph()
     m_timeLine->updateTime(TimeRange_Default_Frame_In, true);
 
     QCoreApplication::processEvents();
-    m_qUndoView->setEmptyLabel( "New Graph" );
+    setUndoEmptyLabel( "New Graph" );
 
     onSidePanelInspectRequested();
 
@@ -799,7 +1839,7 @@ void MainWindow::onLoadGraph()
     return;
 
   QString lastPresetFolder = m_settings->value("mainWindow/lastPresetFolder").toString();
-  QString filePath = QFileDialog::getOpenFileName(this, "Load graph", lastPresetFolder, "*.canvas");
+  QString filePath = QFileDialog::getOpenFileName(this, "Load graph", lastPresetFolder, "*.canvas *.canvasz");
   if ( filePath.length() )
   {
     QDir dir(filePath);
@@ -812,14 +1852,100 @@ void MainWindow::onLoadGraph()
 
 void MainWindow::loadGraph( QString const &filePath )
 {
+  beginGraphLoad( filePath, std::string(), false );
+}
+
+bool MainWindow::recoverAutosave( QString const &autosaveFilePath )
+{
+  std::string json;
+  std::string lastLabel;
+  if ( !AutosaveJournal::Replay(
+    autosaveFilePath.toUtf8().constData(), json, &lastLabel ) )
+  {
+    printf("Error: unable to read %s\n", autosaveFilePath.toUtf8().constData());
+    return false;
+  }
+
+  beginGraphLoad( QString(), json, true );
+
+  if ( !lastLabel.empty() )
+    printf("Recovered autosave up to '%s'\n", lastLabel.c_str());
+  return true;
+}
+
+void MainWindow::setGraphLoadStage( GraphLoadStage stage )
+{
+  m_graphLoadStage = stage;
+
+  // the previous graph is gone while the new one is being parsed
+  bool editable = stage != GraphLoadStage_Parsing;
+  m_dfgWidget->setEnabled( editable );
+  m_dfgValueEditor->setEnabled( editable );
+  m_timeLine->setEnabled( editable );
+  if ( m_saveGraphAction )
+    m_saveGraphAction->setEnabled( editable );
+  if ( m_saveGraphAsAction )
+    m_saveGraphAsAction->setEnabled( editable );
+
+  switch ( stage )
+  {
+    case GraphLoadStage_Idle:
+      m_graphLoadProgressBar->hide();
+      return;
+    case GraphLoadStage_Parsing:
+      m_graphLoadProgressBar->setFormat( "Reading graph..." );
+      break;
+    case GraphLoadStage_Binding:
+      m_graphLoadProgressBar->setFormat( "Binding graph..." );
+      break;
+    case GraphLoadStage_Evaluating:
+      m_graphLoadProgressBar->setFormat( "Compiling and evaluating..." );
+      break;
+  }
+  m_graphLoadProgressBar->setValue( int( stage ) - 1 );
+  m_graphLoadProgressBar->show();
+}
+
+void MainWindow::cancelGraphLoad()
+{
+  if ( m_graphLoadStage == GraphLoadStage_Idle )
+    return;
+
+  // the parsed binding is released with the result
+  m_graphLoader->waitForFinished();
+  setGraphLoadStage( GraphLoadStage_Idle );
+}
+
+void MainWindow::beginGraphLoad(
+  QString const &filePath,
+  std::string const &json,
+  bool isRecovery
+  )
+{
+  CANVAS_TRACE_SCOPE( "beginGraphLoad" );
+
+  cancelGraphLoad();
+  m_compileScheduler->reset();
+
   m_timeLine->pause();
-  m_timelinePortIndex = -1;
+  m_timelinePort.reset();
+  m_rootPorts.clear();
+  m_portDrivers.reset();
 
   try
   {
     FabricUI::DFG::DFGController *dfgController =
       m_dfgWidget->getUIController();
 
+    // the running evaluation and autosave must not outlive the binding
+    m_manipulationSession->discard();
+    m_executor->cancel();
+    m_executor->waitForIdle();
+    m_preroller->release();
+    m_autosaveWriter->waitForFinished();
+    // the graph may use the types of the deferred extensions
+    loadDeferredExtensions();
+
     FabricCore::DFGBinding binding = dfgController->getBinding();
     binding.deallocValues();
 
@@ -827,104 +1953,154 @@ void MainWindow::loadGraph( QString const &filePath )
 
     m_host.flushUndoRedo();
     m_qUndoStack.clear();
-    m_qUndoView->setEmptyLabel( "Load Graph" );
+    invalidateFrameCache();
+    setUndoEmptyLabel( "Load Graph" );
 
     m_viewport->clearInlineDrawing();
+  }
+  catch(FabricCore::Exception e)
+  {
+    printf("Exception: %s\n", e.getDesc_cstr());
+  }
 
-    QCoreApplication::processEvents();
-
-    FILE * file = fopen(filePath.toUtf8().constData(), "rb");
-    if(file)
-    {
-      fseek( file, 0, SEEK_END );
-      int fileSize = ftell( file );
-      rewind( file );
+  m_graphLoadIsRecovery = isRecovery;
+  m_graphLoadTimer.start();
+  setGraphLoadStage( GraphLoadStage_Parsing );
+  m_graphLoader->start( filePath, json );
+}
 
-      char * buffer = (char*) malloc(fileSize + 1);
-      buffer[fileSize] = '\0';
+void MainWindow::onGraphParsed()
+{
+  // a load that was cancelled, or replaced by a newer one
+  if ( m_graphLoadStage != GraphLoadStage_Parsing
+    || m_graphLoader->isLoading() )
+    return;
 
-      fread(buffer, 1, fileSize, file);
+  CANVAS_TRACE_SCOPE( "onGraphParsed" );
 
-      fclose(file);
+  FabricUI::DFG::DFGController *dfgController =
+    m_dfgWidget->getUIController();
+  GraphLoadResult result = m_graphLoader->result();
+  QString filePath = m_graphLoader->filePath();
 
-      std::string json = buffer;
-      free(buffer);
+  if ( !result.error.empty() )
+  {
+    printf("Error: %s\n", result.error.c_str());
+    dfgController->logError( result.error.c_str() );
+    setGraphLoadStage( GraphLoadStage_Idle );
+    return;
+  }
 
-      FabricCore::DFGBinding binding =
-        m_host.createBindingFromJSON( json.c_str() );
-      m_lastSavedBindingVersion = binding.getVersion();
-      FabricCore::DFGExec exec = binding.getExec();
-      dfgController->setBindingExec( binding, FTL::StrRef(), exec );
-      onSidePanelInspectRequested();
+  double sizeMB = double( result.jsonSize ) / ( 1024.0 * 1024.0 );
+  QString loadMessage =
+    QString( "Loaded %1 MB in %2 s (%3 MB/s)" )
+      .arg( sizeMB, 0, 'f', 2 )
+      .arg( result.parseSeconds, 0, 'f', 3 )
+      .arg( result.parseSeconds > 0.0? sizeMB / result.parseSeconds: 0.0, 0, 'f', 1 );
+  dfgController->log( loadMessage.toUtf8().constData() );
 
-      m_dfgWidget->getUIController()->checkErrors();
+  setGraphLoadStage( GraphLoadStage_Binding );
 
-      m_evalContext.setMember("currentFilePath", FabricCore::RTVal::ConstructString(m_client, filePath.toUtf8().constData()));
+  try
+  {
+    FabricCore::DFGBinding binding = result.binding;
+    m_lastSavedBindingVersion = binding.getVersion();
+    m_isUnsavedRecovery = m_graphLoadIsRecovery;
 
-      m_dfgWidget->getUIController()->bindUnboundRTVals();
-      m_dfgWidget->getUIController()->execute();
+    FabricCore::DFGExec exec = binding.getExec();
+    dfgController->setBindingExec( binding, FTL::StrRef(), exec );
+    onSidePanelInspectRequested();
 
-      QString tl_start = exec.getMetadata("timeline_start");
-      QString tl_end = exec.getMetadata("timeline_end");
-      QString tl_loopMode = exec.getMetadata("timeline_loopMode");
-      QString tl_simulationMode = exec.getMetadata("timeline_simMode");
-      QString tl_current = exec.getMetadata("timeline_current");
+    QString tl_start = exec.getMetadata("timeline_start");
+    QString tl_end = exec.getMetadata("timeline_end");
+    QString tl_loopMode = exec.getMetadata("timeline_loopMode");
+    QString tl_simulationMode = exec.getMetadata("timeline_simMode");
 
-      if(tl_start.length() > 0 && tl_end.length() > 0)
-        m_timeLine->setTimeRange(tl_start.toInt(), tl_end.toInt());
-      else
-        m_timeLine->setTimeRange(TimeRange_Default_Frame_In, TimeRange_Default_Frame_Out);
+    if(tl_start.length() > 0 && tl_end.length() > 0)
+      m_timeLine->setTimeRange(tl_start.toInt(), tl_end.toInt());
+    else
+      m_timeLine->setTimeRange(TimeRange_Default_Frame_In, TimeRange_Default_Frame_Out);
 
-      if(tl_loopMode.length() > 0)
-        m_timeLine->setLoopMode(tl_loopMode.toInt());
-      else
-        m_timeLine->setLoopMode(1);
+    if(tl_loopMode.length() > 0)
+      m_timeLine->setLoopMode(tl_loopMode.toInt());
+    else
+      m_timeLine->setLoopMode(1);
 
-      if(tl_simulationMode.length() > 0)
-        m_timeLine->setSimulationMode(tl_simulationMode.toInt());
-      else
-        m_timeLine->setSimulationMode(0);
+    if(tl_simulationMode.length() > 0)
+      m_timeLine->setSimulationMode(tl_simulationMode.toInt());
+    else
+      m_timeLine->setSimulationMode(0);
 
-      QString camera_mat44 = exec.getMetadata("camera_mat44");
-      QString camera_focalDistance = exec.getMetadata("camera_focalDistance");
-      if(camera_mat44.length() > 0 && camera_focalDistance.length() > 0)
+    QString camera_mat44 = exec.getMetadata("camera_mat44");
+    QString camera_focalDistance = exec.getMetadata("camera_focalDistance");
+    if(camera_mat44.length() > 0 && camera_focalDistance.length() > 0)
+    {
+      try
+      {
+        FabricCore::RTVal mat44 = FabricCore::ConstructRTValFromJSON(m_client, "Mat44", camera_mat44.toUtf8().constData());
+        FabricCore::RTVal focalDistance = FabricCore::ConstructRTValFromJSON(m_client, "Float32", camera_focalDistance.toUtf8().constData());
+        FabricCore::RTVal camera = m_viewport->getCamera();
+        camera.callMethod("", "setFromMat44", 1, &mat44);
+        camera.callMethod("", "setFocalDistance", 1, &focalDistance);
+      }
+      catch(FabricCore::Exception e)
       {
-        try
-        {
-          FabricCore::RTVal mat44 = FabricCore::ConstructRTValFromJSON(m_client, "Mat44", camera_mat44.toUtf8().constData());
-          FabricCore::RTVal focalDistance = FabricCore::ConstructRTValFromJSON(m_client, "Float32", camera_focalDistance.toUtf8().constData());
-          FabricCore::RTVal camera = m_viewport->getCamera();
-          camera.callMethod("", "setFromMat44", 1, &mat44);
-          camera.callMethod("", "setFocalDistance", 1, &focalDistance);
-        }
-        catch(FabricCore::Exception e)
-        {
-          printf("Exception: %s\n", e.getDesc_cstr());
-        }
+        printf("Exception: %s\n", e.getDesc_cstr());
       }
+    }
 
-      emit contentChanged();
-      onStructureChanged();
+    m_evalContext.setMember("currentFilePath", FabricCore::RTVal::ConstructString(m_client, filePath.toUtf8().constData()));
+  }
+  catch(FabricCore::Exception e)
+  {
+    printf("Exception: %s\n", e.getDesc_cstr());
+  }
 
-      onFileNameChanged( filePath );
+  onFileNameChanged( filePath );
+  m_lastFileName = filePath;
 
-      // then set it to the current value if we still have it.
-      // this will ensure that sim mode scenes will play correctly.
-      if(tl_current.length() > 0)
-        m_timeLine->updateTime(tl_current.toInt(), true);
-      else
-        m_timeLine->updateTime(TimeRange_Default_Frame_In, true);
+  // the structure is shown before the arguments are bound and the
+  // graph is compiled
+  QTimer::singleShot( 0, this, SLOT(bindLoadedGraph()) );
+}
 
-      m_viewport->update();
-    }
+void MainWindow::bindLoadedGraph()
+{
+  if ( m_graphLoadStage != GraphLoadStage_Binding )
+    return;
+
+  CANVAS_TRACE_SCOPE( "bindLoadedGraph" );
+
+  try
+  {
+    FabricUI::DFG::DFGController *dfgController =
+      m_dfgWidget->getUIController();
+    dfgController->checkErrors();
+    dfgController->bindUnboundRTVals();
+
+    emit contentChanged();
+    onStructureChanged();
+
+    // then set it to the current value if we still have it.
+    // this will ensure that sim mode scenes will play correctly.
+    QString tl_current =
+      dfgController->getBinding().getExec().getMetadata("timeline_current");
+    if(tl_current.length() > 0)
+      m_timeLine->updateTime(tl_current.toInt(), true);
+    else
+      m_timeLine->updateTime(TimeRange_Default_Frame_In, true);
   }
   catch(FabricCore::Exception e)
   {
     printf("Exception: %s\n", e.getDesc_cstr());
   }
 
-  m_lastFileName = filePath;
-  // m_saveGraphAction->setEnabled(true);
+  // the first evaluation compiles the graph on the executor's thread;
+  // the load completes with its result
+  setGraphLoadStage( GraphLoadStage_Evaluating );
+  onDirty();
+
+  m_viewport->update();
 }
 
 void MainWindow::onSaveGraph()
@@ -937,10 +2113,7 @@ void MainWindow::onSaveGraphAs()
   saveGraph(true);
 }
 
-bool MainWindow::performSave(
-  FabricCore::DFGBinding &binding,
-  QString const &filePath
-  )
+void MainWindow::writeSaveMetadata( FabricCore::DFGBinding &binding )
 {
   FabricCore::DFGExec graph = binding.getExec();
 
@@ -971,6 +2144,16 @@ bool MainWindow::performSave(
   {
     printf("Exception: %s\n", e.getDesc_cstr());
   }
+}
+
+bool MainWindow::performSave(
+  FabricCore::DFGBinding &binding,
+  QString const &filePath
+  )
+{
+  CANVAS_TRACE_SCOPE( "performSave" );
+
+  writeSaveMetadata( binding );
 
   try
   {
@@ -978,11 +2161,10 @@ bool MainWindow::performSave(
     char const *jsonData;
     uint32_t jsonSize;
     json.getStringDataAndLength( jsonData, jsonSize );
-    FILE * file = fopen(filePath.toUtf8().constData(), "wb");
-    if(file)
+    if ( !WriteCanvasDocument( filePath.toUtf8().constData(), jsonData, jsonSize ) )
     {
-      fwrite(jsonData, jsonSize, 1, file);
-      fclose(file);
+      printf("Error: unable to write %s\n", filePath.toUtf8().constData());
+      return false;
     }
   }
   catch(FabricCore::Exception e)
@@ -996,6 +2178,10 @@ bool MainWindow::performSave(
 
 bool MainWindow::saveGraph(bool saveAs)
 {
+  // also reached from the hotkey, which the disabled actions don't cover
+  if ( m_graphLoadStage == GraphLoadStage_Parsing )
+    return false;
+
   m_timeLine->pause();
 
   QString filePath = m_lastFileName;
@@ -1007,15 +2193,27 @@ bool MainWindow::saveGraph(bool saveAs)
       filePath = m_lastFileName;
       if(filePath.toLower().endsWith(".canvas"))
         filePath = filePath.left(filePath.length() - 7);
+      else if(filePath.toLower().endsWith(".canvasz"))
+        filePath = filePath.left(filePath.length() - 8);
     }
     else
       filePath = lastPresetFolder;
 
-    filePath = QFileDialog::getSaveFileName(this, "Save graph", filePath, "*.canvas");
+    // the format is chosen from the extension, see WriteCanvasDocument()
+    QString selectedFilter;
+    filePath = QFileDialog::getSaveFileName(this, "Save graph", filePath, "*.canvas;;*.canvasz", &selectedFilter);
     if(filePath.length() == 0)
       return false;
     if(filePath.toLower().endsWith(".canvas.canvas"))
       filePath = filePath.left(filePath.length() - 7);
+    else if(filePath.toLower().endsWith(".canvasz.canvasz"))
+      filePath = filePath.left(filePath.length() - 8);
+    else if(selectedFilter == "*.canvasz" && !filePath.toLower().endsWith(".canvasz"))
+    {
+      if(filePath.toLower().endsWith(".canvas"))
+        filePath = filePath.left(filePath.length() - 7);
+      filePath += ".canvasz";
+    }
   }
 
   QDir dir(filePath);
@@ -1035,15 +2233,14 @@ bool MainWindow::saveGraph(bool saveAs)
   // m_saveGraphAction->setEnabled(true);
 
   m_lastSavedBindingVersion = binding.getVersion();
+  m_isUnsavedRecovery = false;
 
   return true;
 }
 
 void MainWindow::setBlockCompilations( bool blockCompilations )
 {
-  FabricUI::DFG::DFGController *dfgController =
-    m_dfgWidget->getDFGController();
-  dfgController->setBlockCompilations( blockCompilations );
+  m_compileScheduler->setManuallyBlocked( blockCompilations );
 }
 
 void MainWindow::onFileNameChanged(QString fileName)
@@ -1078,6 +2275,10 @@ void MainWindow::enableShortCuts(bool enabled)
     m_clearLogAction->blockSignals(enabled);
   if(m_blockCompilationsAction)
     m_blockCompilationsAction->blockSignals(enabled);
+  if(m_frameCacheAction)
+    m_frameCacheAction->blockSignals(enabled);
+  if(m_traceAction)
+    m_traceAction->blockSignals(enabled);
 }
  
 void MainWindow::onAdditionalMenuActionsRequested(QString name, QMenu * menu, bool prefix)
@@ -1177,7 +2378,7 @@ void MainWindow::onAdditionalMenuActionsRequested(QString name, QMenu * menu, bo
       m_clearLogAction = new QAction( "&Clear Log Messages", 0 );
       QObject::connect(
         m_clearLogAction, SIGNAL(triggered()),
-        m_logWidget, SLOT(clear())
+        this, SLOT(clearLog())
         );
 
       m_blockCompilationsAction = new QAction( "&Block compilations", 0 );
@@ -1188,6 +2389,14 @@ void MainWindow::onAdditionalMenuActionsRequested(QString name, QMenu * menu, bo
         this, SLOT(setBlockCompilations(bool))
         );
 
+      m_deferCompilationsAction = new QAction( "&Defer compilations while editing", 0 );
+      m_deferCompilationsAction->setCheckable( true );
+      m_deferCompilationsAction->setChecked( m_compileScheduler->isEnabled() );
+      QObject::connect(
+        m_deferCompilationsAction, SIGNAL(toggled(bool)),
+        m_compileScheduler, SLOT(setEnabled(bool))
+        );
+
       // [Julien] FE-4965
       menu->addAction( m_setGridVisibleAction );
       //menu->addAction( m_setUsingStageAction );
@@ -1197,32 +2406,84 @@ void MainWindow::onAdditionalMenuActionsRequested(QString name, QMenu * menu, bo
       menu->addAction( m_clearLogAction );
       menu->addSeparator();
       menu->addAction( m_blockCompilationsAction );
+      menu->addAction( m_deferCompilationsAction );
+
+      m_frameCacheAction = new QAction( "Cache &Playback Frames of Headless Graphs", 0 );
+      m_frameCacheAction->setCheckable( true );
+      m_frameCacheAction->setStatusTip(
+        "Keep the output values of evaluated frames; graphs that draw in the viewport are not cached"
+        );
+      m_frameCacheAction->setChecked( m_frameCacheEnabled );
+      QObject::connect(
+        m_frameCacheAction, SIGNAL(toggled(bool)),
+        this, SLOT(setFrameCacheEnabled(bool))
+        );
+      menu->addAction( m_frameCacheAction );
+
+      m_traceAction = new QAction( "Record &Trace", 0 );
+      m_traceAction->setCheckable( true );
+      m_traceAction->setChecked( TraceRecorder::IsRecording() );
+      QObject::connect(
+        m_traceAction, SIGNAL(toggled(bool)),
+        this, SLOT(setTraceRecording(bool))
+        );
+      menu->addSeparator();
+      menu->addAction( m_traceAction );
     }
   }
 }
 
 void MainWindow::autosave()
 {
+  CANVAS_TRACE_SCOPE( "autosave" );
+
   // [andrew 20150909] can happen if this triggers while the licensing
   // dialogs are up
   if ( !m_dfgWidget || !m_dfgWidget->getUIController() )
     return;
 
+  // the previous autosave is still being written; try again next time
+  if ( m_autosaveWriter->isBusy() )
+    return;
+
+  // the previous graph is no longer there to be saved
+  if ( m_graphLoadStage == GraphLoadStage_Parsing )
+    return;
+
+  // the metadata is written here, and cannot be while the binding is
+  // evaluated or exported
+  if ( m_executor->isBusy() )
+    return;
+
   FabricCore::DFGBinding binding = m_dfgWidget->getUIController()->getBinding();
   if ( !!binding )
   {
     uint32_t bindingVersion = binding.getVersion();
     if ( bindingVersion != m_lastAutosaveBindingVersion )
     {
-      std::string tmpAutosaveFilename = m_autosaveFilename;
-      tmpAutosaveFilename += FTL_STR(".tmp");
-
-      if ( performSave( binding, tmpAutosaveFilename.c_str() ) )
-      {
-        FTL::FSMaybeMoveFile( tmpAutosaveFilename, m_autosaveFilename );
-
-        m_lastAutosaveBindingVersion = bindingVersion;
-      }
+      // the export happens on the executor's thread, the journal diff
+      // and the write on the autosave writer's thread
+      // the last undo command labels the journal record
+      m_autosaveLabel = QString();
+      if ( m_qUndoStack.index() > 0 )
+        m_autosaveLabel = m_qUndoStack.text( m_qUndoStack.index() - 1 );
+
+      writeSaveMetadata( binding );
+      m_executor->requestExport( binding );
     }
   }
 }
+
+void MainWindow::onAutosaveExported( QByteArray json, unsigned bindingVersion )
+{
+  if ( json.isEmpty() )
+    return;
+
+  m_autosaveWriter->start( json, bindingVersion, m_autosaveLabel );
+}
+
+void MainWindow::onAutosaveFinished( bool succeeded, unsigned bindingVersion )
+{
+  if ( succeeded )
+    m_lastAutosaveBindingVersion = bindingVersion;
+}
@@ -2,7 +2,10 @@
 // Copyright 2010-2015 Fabric Software Inc. All rights reserved.
 //
 
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutex>
 #include <QtCore/QSettings>
+#include <QtCore/QStringList>
 #include <QtGui/QApplication>
 #include <QtGui/QDockWidget>
 #include <QtGui/QKeyEvent>
@@ -21,6 +24,24 @@
 #include <FabricUI/Viewports/TimeLineWidget.h>
 #include <FabricUI/Viewports/GLViewportWidget.h>
 
+#include <string>
+#include <vector>
+
+#include "CanvasAutosave.h"
+#include "CanvasCompile.h"
+#include "CanvasExecutor.h"
+#include "CanvasExtensionIndex.h"
+#include "CanvasFrameCache.h"
+#include "CanvasLoad.h"
+#include "CanvasManipulation.h"
+#include "CanvasPerformance.h"
+#include "CanvasPortDrivers.h"
+#include "CanvasPreroll.h"
+#include "CanvasPresetSearch.h"
+#include "CanvasStartup.h"
+#include "CanvasTimeline.h"
+#include "CanvasUndo.h"
+
 #define TimeRange_Default_Frame_In      1
 #define TimeRange_Default_Frame_Out     50
 
@@ -28,8 +49,27 @@ using namespace FabricServices;
 using namespace FabricUI;
 
 class MainWindow;
+class QProgressBar;
+class QPushButton;
 class QUndoView;
 
+struct MainWindowOptions
+{
+  bool unguarded;
+  // create the hidden docks and the preset tree the first time they are
+  // shown, and load the optional extensions once the first frame is drawn
+  bool lazyStartup;
+  // receives the phases of the construction when set
+  StartupProfiler *startupProfiler;
+
+  MainWindowOptions()
+    : unguarded( false )
+    , lazyStartup( false )
+    , startupProfiler( NULL )
+  {
+  }
+};
+
 class MainWindowEventFilter : public QObject
 {
 public:
@@ -53,11 +93,19 @@ public:
 
   MainWindow(
     QSettings *settings,
-    bool unguarded
+    MainWindowOptions const &options
     );
   ~MainWindow();
 
   void loadGraph( QString const &filePath );
+  // rebuilds a graph from an autosave checkpoint and its journal
+  bool recoverAutosave( QString const &autosaveFilePath );
+  // makes the given root ports follow the port when it is manipulated
+  // in the viewport; an empty list removes the group
+  void setManipulationGroup(
+    QString const &portName,
+    QStringList const &groupPortNames
+    );
   static void CoreStatusCallback( void *userdata, char const *destinationData,
                                   uint32_t destinationLength,
                                   char const *payloadData,
@@ -66,6 +114,8 @@ public:
 public slots:
 
   void onDirty();
+  void onExecuted( double elapsedMS, int frame, unsigned generation );
+  void onExecutionFailed( QString message );
   void onValueChanged();
   void onStructureChanged();
   void onGraphSet(FabricUI::GraphView::Graph * graph);
@@ -81,12 +131,41 @@ public slots:
   void updateFPS();
   void onPortManipulationRequested(QString portName);
   void setBlockCompilations( bool blockCompilations );
+  void setFrameCacheEnabled( bool enabled );
+  void invalidateFrameCache();
+  void setTraceRecording( bool recording );
   void onFileNameChanged(QString fileName);
   void enableShortCuts(bool enabled);
+  // to be invoked once the window has been shown and drawn
+  void onStartupFinished();
+  void clearLog();
 
 private slots:
   void onAdditionalMenuActionsRequested(QString name, QMenu * menu, bool prefix);
   void autosave();
+  void onAutosaveExported( QByteArray json, unsigned bindingVersion );
+  void onAutosaveFinished( bool succeeded, unsigned bindingVersion );
+  void onDirtyNotified();
+  void onValuesNotified();
+  void onStructureNotified();
+  void flushPendingUpdates();
+  void onSlowOperationPushed( QString description );
+  void onSlowOperationPopped();
+  void onLicenseData( QString payload );
+  void updateSlowOperationLabel();
+  void cancelSlowOperation();
+  void onContentChanged();
+  void createVisibleDockWidgets();
+  void onExtensionIndexFinished( unsigned parsedCount, unsigned failedCount );
+  void onPresetActivated( QString presetPath );
+  void schedulePresetTreeRefresh();
+  void flushPresetTreeRefresh();
+  void onUndoIndexChanged();
+  void onGraphParsed();
+  void updateCompileQueueLabel();
+  void bindLoadedGraph();
+  void trimUndoHistory();
+  void loadDeferredExtensions();
 
 signals:
   void contentChanged();
@@ -97,6 +176,70 @@ protected:
   bool saveGraph(bool saveAs);
   bool checkUnsavedChanged();
 
+  // graphs are loaded in stages: the document is parsed on a worker,
+  // then bound to the controller and shown, then evaluated through the
+  // executor (which compiles it)
+  enum GraphLoadStage
+  {
+    GraphLoadStage_Idle,
+    GraphLoadStage_Parsing,
+    GraphLoadStage_Binding,
+    GraphLoadStage_Evaluating
+  };
+  void beginGraphLoad(
+    QString const &filePath,
+    std::string const &json,
+    bool isRecovery
+    );
+  void setGraphLoadStage( GraphLoadStage stage );
+  // drops the load in flight, if any
+  void cancelGraphLoad();
+
+  enum PendingUpdate
+  {
+    PendingUpdate_Structure = 1 << 0,
+    PendingUpdate_Dirty     = 1 << 1,
+    PendingUpdate_Values    = 1 << 2
+  };
+  void schedulePendingUpdate( PendingUpdate update );
+
+  void applyPortDrivers( int frame );
+  void storeFrameInCache( int frame );
+  bool restoreFrameFromCache( int frame );
+
+  void markStartupPhase( char const *phase );
+  void createPresetTreeWidget();
+  void createLogWidget();
+  void createUndoView();
+  void setUndoEmptyLabel( QString const &label );
+  void updateUndoBudgetLabel();
+
+  // extensions loaded after the first frame in lazy startup mode
+  void startDeferredExtensionLoad();
+  void loadExtensions( QStringList names );
+
+  // the messages logged before the Log dock is first shown are kept, and
+  // replayed into it when it is created
+  static void LogCallback(
+    void *userdata,
+    FEC_ReportSource source,
+    FEC_ReportLevel level,
+    char const *data,
+    uint32_t size
+    );
+  void log( char const *message );
+  void logError( char const *message );
+  struct PendingLogMessage
+  {
+    // the core's messages go back through its callback
+    bool fromCore;
+    FEC_ReportSource source;
+    FEC_ReportLevel level;
+    std::string text;
+  };
+  void keepLogMessage( PendingLogMessage const &message );
+
+  void writeSaveMetadata( FabricCore::DFGBinding &binding );
   bool performSave(
     FabricCore::DFGBinding &binding,
     QString const &filePath
@@ -105,31 +248,97 @@ protected:
 private:
 
   QUndoStack m_qUndoStack;
-  DFG::DFGUICmdHandler_QUndo m_dfguiCommandHandler;
+  BudgetedCmdHandler m_dfguiCommandHandler;
 
   QSettings *m_settings;
 
   FabricCore::Client m_client;
   ASTWrapper::KLASTManager * m_manager;
+  ExtensionIndexer *m_extensionIndexer;
   FabricCore::DFGHost m_host;
   FabricCore::RTVal m_evalContext;
+  // updated in place for each frame
+  FabricCore::RTVal m_evalContextTime;
+  GraphExecutor *m_executor;
   DFG::PresetTreeWidget * m_treeWidget;
+  PresetSearchWidget *m_presetSearchWidget;
+  // preset tree refreshes are merged, and deferred while it is hidden
+  bool m_presetTreeRefreshPending;
+  QTimer m_presetTreeRefreshTimer;
   DFG::DFGWidget * m_dfgWidget;
   DFG::DFGValueEditor * m_dfgValueEditor;
   FabricUI::GraphView::Graph * m_setGraph;
   Viewports::GLViewportWidget * m_viewport;
+  ManipulationSession *m_manipulationSession;
+  CompileScheduler *m_compileScheduler;
+  QLabel *m_compileQueueLabel;
   DFG::DFGLogWidget * m_logWidget;
   QUndoView *m_qUndoView;
+  QString m_undoEmptyLabel;
+  QLabel *m_undoBudgetLabel;
+  bool m_undoTrimPending;
   Viewports::TimeLineWidget * m_timeLine;
-  int m_timelinePortIndex;
+  RootPortMap m_rootPorts;
+  TimelinePort m_timelinePort;
+  PortDriverRegistry m_portDrivers;
+  int m_lastDrivenFrame;
   QStatusBar *m_statusBar;
   QTimer m_fpsTimer;
   QLabel *m_fpsLabel;
 
+  // in lazy startup mode the widgets of these docks are created the
+  // first time the dock is visible after startup
+  bool m_lazyStartup;
+  bool m_startupFinished;
+  StartupProfiler *m_startupProfiler;
+  QDockWidget *m_treeDock;
+  QDockWidget *m_logDock;
+  QDockWidget *m_undoDock;
+  QStringList m_deferredExtensions;
+
+  // guarded by m_logMutex, since the core reports from any thread
+  std::vector<PendingLogMessage> m_pendingLogMessages;
+  unsigned m_droppedLogMessageCount;
+  QMutex m_logMutex;
+
+  GraphLoader *m_graphLoader;
+  GraphLoadStage m_graphLoadStage;
+  bool m_graphLoadIsRecovery;
+  QElapsedTimer m_graphLoadTimer;
+  QProgressBar *m_graphLoadProgressBar;
+
+  // the timings gathered for the frame being prepared; handed to the
+  // performance widget once the viewport has been redrawn
+  PerformanceWidget *m_performanceWidget;
+  PerformanceSample m_performanceSample;
+
+  // controller notifications are gathered and flushed once per
+  // event loop iteration
+  unsigned m_pendingUpdates;
+  QTimer m_pendingUpdatesTimer;
+  uint32_t m_avoidedEvaluationCount;
+  QLabel *m_avoidedEvaluationsLabel;
+
+  // playback cache; m_editGeneration advances with every edit and
+  // keys the cached frames together with the frame number
+  bool m_frameCacheEnabled;
+  FrameCache m_frameCache;
+  FrameCacheBar *m_frameCacheBar;
+  uint32_t m_editGeneration;
+  bool m_graphDrawsInline;
+  FramePreroller *m_preroller;
+
+  // the core reports slow operations (compilations, long evaluations)
+  // as nested push/pop pairs; the dialog appears once the outermost
+  // one has lasted longer than the configured delay
   QDialog *m_slowOperationDialog;
   QLabel *m_slowOperationLabel;
+  QPushButton *m_slowOperationCancelButton;
   uint32_t m_slowOperationDepth;
+  QStringList m_slowOperationDescriptions;
+  QElapsedTimer m_slowOperationElapsedTimer;
   QTimer *m_slowOperationTimer;
+  QTimer *m_slowOperationRefreshTimer;
 
   QAction *m_newGraphAction;
   QAction *m_loadGraphAction;
@@ -143,13 +352,22 @@ private:
   QAction * m_resetCameraAction;
   QAction * m_clearLogAction;
   QAction * m_blockCompilationsAction;
+  QAction * m_deferCompilationsAction;
+  QAction * m_frameCacheAction;
+  QAction * m_traceAction;
 
   QString m_windowTitle;
   QString m_lastFileName;
 
   uint32_t m_lastSavedBindingVersion;
+  // a recovered autosave has never been saved by the user, whatever
+  // its version
+  bool m_isUnsavedRecovery;
 
   static const uint32_t s_autosaveIntervalSec = 30;
   std::string m_autosaveFilename;
   uint32_t m_lastAutosaveBindingVersion;
+  // labels the autosave being exported
+  QString m_autosaveLabel;
+  AutosaveWriter *m_autosaveWriter;
 };
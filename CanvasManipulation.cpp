@@ -0,0 +1,351 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasManipulation.h"
+
+#include <FTL/StrRef.h>
+
+#include <QtCore/QEvent>
+
+ManipulationSession::ManipulationSession(
+  FabricUI::DFG::DFGController *controller,
+  GraphExecutor *executor,
+  QUndoStack *undoStack,
+  unsigned maxRateHz,
+  QObject *parent
+  )
+  : QObject( parent )
+  , m_controller( controller )
+  , m_executor( executor )
+  , m_undoStack( undoStack )
+  , m_active( false )
+  , m_lastValuesApplied( true )
+{
+  m_throttleTimer.setSingleShot( true );
+  m_throttleTimer.setInterval( 1000 / ( maxRateHz > 0? maxRateHz: 60 ) );
+  connect( &m_throttleTimer, SIGNAL(timeout()), this, SLOT(flush()) );
+
+  // for a drag that does not end with a mouse release over the viewport
+  m_idleTimer.setSingleShot( true );
+  m_idleTimer.setInterval( 1000 );
+  connect( &m_idleTimer, SIGNAL(timeout()), this, SLOT(end()) );
+}
+
+ManipulationSession::Conversion ManipulationSession::conversion(
+  std::string const &portName
+  )
+{
+  std::map<std::string, Conversion>::const_iterator it =
+    m_conversions.find( portName );
+  if ( it != m_conversions.end() )
+    return it->second;
+
+  FabricCore::DFGExec exec = m_controller->getBinding().getExec();
+  FTL::StrRef portResolvedType =
+    exec.getExecPortResolvedType( portName.c_str() );
+
+  Conversion result = Conversion_Unsupported;
+  if ( portResolvedType == "Xfo" )
+    result = Conversion_Xfo;
+  else if ( portResolvedType == "Mat44" )
+    result = Conversion_Mat44;
+  else if ( portResolvedType == "Vec3" )
+    result = Conversion_Vec3;
+  else if ( portResolvedType == "Quat" )
+    result = Conversion_Quat;
+  else
+  {
+    // reported once, rather than on every drag event
+    std::string message = "Port '" + portName;
+    message += "'to be driven has unsupported type '";
+    message += std::string( portResolvedType.data(), portResolvedType.size() );
+    message += "'.";
+    m_controller->logError( message.c_str() );
+  }
+
+  m_conversions[portName] = result;
+  return result;
+}
+
+FabricCore::RTVal ManipulationSession::Convert(
+  Conversion conversion,
+  FabricCore::RTVal manipValue
+  )
+{
+  switch ( conversion )
+  {
+    case Conversion_Xfo:
+      return manipValue;
+    case Conversion_Mat44:
+      return manipValue.callMethod( "Mat44", "toMat44", 0, 0 );
+    case Conversion_Vec3:
+      return manipValue.maybeGetMember( "tr" );
+    case Conversion_Quat:
+      return manipValue.maybeGetMember( "ori" );
+    case Conversion_Unsupported:
+      break;
+  }
+  return FabricCore::RTVal();
+}
+
+FabricCore::RTVal ManipulationSession::toXfo(
+  Conversion conversion,
+  FabricCore::RTVal value
+  )
+{
+  if ( conversion == Conversion_Xfo )
+    return value.copy();
+
+  FabricCore::RTVal xfo =
+    FabricCore::RTVal::Construct( m_controller->getClient(), "Xfo", 0, 0 );
+  switch ( conversion )
+  {
+    case Conversion_Mat44:
+      xfo.callMethod( "", "setFromMat44", 1, &value );
+      break;
+    case Conversion_Vec3:
+      xfo.setMember( "tr", value );
+      break;
+    case Conversion_Quat:
+      xfo.setMember( "ori", value );
+      break;
+    default:
+      break;
+  }
+  return xfo;
+}
+
+void ManipulationSession::setGroup(
+  QString const &portName,
+  QStringList const &groupPortNames
+  )
+{
+  m_setGroups[portName] = groupPortNames;
+}
+
+void ManipulationSession::removeGroup( QString const &portName )
+{
+  m_setGroups.erase( portName );
+}
+
+QStringList ManipulationSession::group( QString const &portName )
+{
+  std::map<QString, QStringList>::const_iterator it =
+    m_setGroups.find( portName );
+  if ( it == m_setGroups.end() )
+    return metadataGroup( portName );
+
+  QStringList portNames;
+  portNames << portName;
+  for ( int i = 0; i < it->second.size(); ++i )
+  {
+    if ( !portNames.contains( it->second[i] ) )
+      portNames << it->second[i];
+  }
+  return portNames;
+}
+
+QStringList const &ManipulationSession::metadataGroup( QString const &portName )
+{
+  std::map<QString, QStringList>::const_iterator it = m_groups.find( portName );
+  if ( it != m_groups.end() )
+    return it->second;
+
+  // the port itself first, then the ports it moves along with it
+  QStringList portNames;
+  portNames << portName;
+  FabricCore::DFGExec exec = m_controller->getBinding().getExec();
+  QString groupMetadata = exec.getExecPortMetadata(
+    portName.toUtf8().constData(),
+    "manipulationGroup"
+    );
+  QStringList groupPortNames = groupMetadata.split( ',', QString::SkipEmptyParts );
+  for ( int i = 0; i < groupPortNames.size(); ++i )
+  {
+    QString groupPortName = groupPortNames[i].trimmed();
+    if ( !groupPortName.isEmpty() && !portNames.contains( groupPortName ) )
+      portNames << groupPortName;
+  }
+
+  return m_groups[portName] = portNames;
+}
+
+void ManipulationSession::update(
+  QString const &portName,
+  FabricCore::RTVal manipValue
+  )
+{
+  try
+  {
+    update( group( portName ), manipValue );
+  }
+  catch ( FabricCore::Exception e )
+  {
+    m_controller->logError( e.getDesc_cstr() );
+  }
+}
+
+void ManipulationSession::update(
+  QStringList const &portNames,
+  FabricCore::RTVal manipValue
+  )
+{
+  if ( m_active && portNames != m_portNames )
+    end();
+
+  try
+  {
+    if ( !m_active )
+    {
+      for ( int i = 0; i < portNames.size(); ++i )
+      {
+        Port port;
+        port.name = portNames[i].toUtf8().constData();
+        port.conversion = conversion( port.name );
+        if ( port.conversion == Conversion_Unsupported )
+          continue;
+        // kept for the undo entry committed at the end
+        port.originalValue =
+          m_controller->getBinding().getArgValue( port.name.c_str() ).copy();
+        port.originalXfo = toXfo( port.conversion, port.originalValue );
+        m_ports.push_back( port );
+      }
+      if ( m_ports.empty() )
+        return;
+      m_portNames = portNames;
+      m_active = true;
+
+      // the offsets are taken from the driven port; without it, from
+      // the first manipulator value of the drag
+      FabricCore::RTVal reference =
+        m_ports[0].name == m_portNames[0].toUtf8().constData()?
+          m_ports[0].originalXfo: manipValue;
+      m_referenceInverse = reference.callMethod( "Xfo", "inverse", 0, 0 );
+    }
+
+    // each port moves from its own original value by the offset of the
+    // manipulator from the reference
+    FabricCore::RTVal offset =
+      manipValue.callMethod( "Xfo", "multiply", 1, &m_referenceInverse );
+    for ( size_t i = 0; i < m_ports.size(); ++i )
+    {
+      FabricCore::RTVal xfo =
+        offset.callMethod( "Xfo", "multiply", 1, &m_ports[i].originalXfo );
+      m_ports[i].lastValue = Convert( m_ports[i].conversion, xfo );
+    }
+    m_lastValuesApplied = false;
+  }
+  catch ( FabricCore::Exception e )
+  {
+    m_controller->logError( e.getDesc_cstr() );
+    return;
+  }
+
+  m_idleTimer.start();
+
+  // the events in between two display refreshes only leave their
+  // last value
+  if ( !m_throttleTimer.isActive() )
+    flush();
+}
+
+void ManipulationSession::flush()
+{
+  if ( !m_active || m_lastValuesApplied )
+    return;
+
+  try
+  {
+    // set through the executor, without undo records: the core would
+    // otherwise keep one per step until the history is flushed. the
+    // dirty notifications of the group are merged into a single
+    // evaluation per step
+    FabricCore::DFGBinding &binding = m_controller->getBinding();
+    for ( size_t i = 0; i < m_ports.size(); ++i )
+      m_executor->setArgValue(
+        binding,
+        m_ports[i].name.c_str(),
+        m_ports[i].lastValue
+        );
+  }
+  catch ( FabricCore::Exception e )
+  {
+    m_controller->logError( e.getDesc_cstr() );
+  }
+
+  m_lastValuesApplied = true;
+  m_throttleTimer.start();
+}
+
+void ManipulationSession::end()
+{
+  if ( !m_active )
+    return;
+
+  m_throttleTimer.stop();
+  m_idleTimer.stop();
+  m_active = false;
+
+  // the commands below reach the binding from the UI thread
+  m_executor->waitForIdle();
+
+  try
+  {
+    // the commands record the values they replace for their undo, so
+    // the ports are put back to their values from before the drag first
+    FabricCore::DFGBinding &binding = m_controller->getBinding();
+    for ( size_t i = 0; i < m_ports.size(); ++i )
+    {
+      if ( m_ports[i].originalValue.isValid() )
+        binding.setArgValue(
+          m_ports[i].name.c_str(),
+          m_ports[i].originalValue,
+          false
+          );
+    }
+
+    // a single undo entry for the whole group
+    if ( m_ports.size() > 1 )
+      m_undoStack->beginMacro( "Manipulate " + m_portNames.join( ", " ) );
+    for ( size_t i = 0; i < m_ports.size(); ++i )
+    {
+      if ( m_ports[i].lastValue.isValid() )
+        m_controller->cmdSetArgValue( m_ports[i].name, m_ports[i].lastValue );
+    }
+    if ( m_ports.size() > 1 )
+      m_undoStack->endMacro();
+  }
+  catch ( FabricCore::Exception e )
+  {
+    m_controller->logError( e.getDesc_cstr() );
+  }
+
+  clear();
+}
+
+void ManipulationSession::clear()
+{
+  m_ports.clear();
+  m_portNames.clear();
+  m_referenceInverse = FabricCore::RTVal();
+  m_lastValuesApplied = true;
+}
+
+void ManipulationSession::discard()
+{
+  m_throttleTimer.stop();
+  m_idleTimer.stop();
+  m_active = false;
+  clear();
+  invalidateConversions();
+  // the groups belong to the binding being replaced
+  m_setGroups.clear();
+}
+
+bool ManipulationSession::eventFilter( QObject *object, QEvent *event )
+{
+  if ( m_active && event->type() == QEvent::MouseButtonRelease )
+    end();
+  return QObject::eventFilter( object, event );
+}
@@ -0,0 +1,135 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_MANIPULATION_H__
+#define __CANVAS_MANIPULATION_H__
+
+#include "CanvasExecutor.h"
+
+#include <FabricCore.h>
+#include <FabricUI/DFG/DFGUI.h>
+
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
+#include <QtGui/QUndoStack>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// One drag of a viewport manipulator on a group of root ports: the port
+// the viewport drives, plus the ports of its group (set with setGroup(),
+// or else listed in its "manipulationGroup" metadata). The driven port
+// receives the manipulator value; the others move by the same offset from
+// their own original values, converted to their own types. While the drag
+// lasts, the values are set on the binding directly,
+// at most once per display refresh, without undo commands and with a
+// single evaluation per step; when it ends (on mouse release, or after a
+// pause) the ports are put back to their original values and the last
+// ones are committed as one undo entry.
+class ManipulationSession : public QObject
+{
+  Q_OBJECT
+
+public:
+
+  ManipulationSession(
+    FabricUI::DFG::DFGController *controller,
+    GraphExecutor *executor,
+    QUndoStack *undoStack,
+    unsigned maxRateHz,
+    QObject *parent = NULL
+    );
+
+  bool isActive() const
+    { return m_active; }
+
+  // applies the manipulator value to the port, and its offset to the
+  // ports of its group
+  void update( QString const &portName, FabricCore::RTVal manipValue );
+  // drives the given ports together, the first one receiving the
+  // manipulator value, whatever their groups
+  void update( QStringList const &portNames, FabricCore::RTVal manipValue );
+
+  // makes the given ports follow the port when it is manipulated,
+  // overriding its "manipulationGroup" metadata
+  void setGroup( QString const &portName, QStringList const &groupPortNames );
+  // goes back to the "manipulationGroup" metadata of the port
+  void removeGroup( QString const &portName );
+  // the port, followed by the ports that follow it
+  QStringList group( QString const &portName );
+
+  // the port types and metadata may have changed
+  void invalidateConversions()
+    { m_conversions.clear(); m_groups.clear(); }
+
+  // ends the drag on mouse release
+  virtual bool eventFilter( QObject *object, QEvent *event );
+
+public slots:
+
+  void end();
+  // forgets the drag without committing it, for a binding that is
+  // about to be replaced
+  void discard();
+
+private slots:
+
+  void flush();
+
+private:
+
+  enum Conversion
+  {
+    Conversion_Unsupported,
+    Conversion_Xfo,
+    Conversion_Mat44,
+    Conversion_Vec3,
+    Conversion_Quat
+  };
+
+  struct Port
+  {
+    std::string name;
+    Conversion conversion;
+    FabricCore::RTVal originalValue;
+    // the original value as an Xfo, which the offsets apply to
+    FabricCore::RTVal originalXfo;
+    FabricCore::RTVal lastValue;
+  };
+
+  Conversion conversion( std::string const &portName );
+  QStringList const &metadataGroup( QString const &portName );
+  FabricCore::RTVal toXfo(
+    Conversion conversion,
+    FabricCore::RTVal value
+    );
+  static FabricCore::RTVal Convert(
+    Conversion conversion,
+    FabricCore::RTVal manipValue
+    );
+
+  void clear();
+
+  FabricUI::DFG::DFGController *m_controller;
+  GraphExecutor *m_executor;
+  QUndoStack *m_undoStack;
+  // resolved once per port rather than once per drag event
+  std::map<std::string, Conversion> m_conversions;
+  std::map<QString, QStringList> m_groups;
+  std::map<QString, QStringList> m_setGroups;
+
+  bool m_active;
+  QStringList m_portNames;
+  std::vector<Port> m_ports;
+  // the inverse of the driven port's Xfo when the drag started
+  FabricCore::RTVal m_referenceInverse;
+  bool m_lastValuesApplied;
+  QTimer m_throttleTimer;
+  QTimer m_idleTimer;
+};
+
+#endif // __CANVAS_MANIPULATION_H__
@@ -0,0 +1,264 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasPerformance.h"
+
+#include <QtGui/QFileDialog>
+#include <QtGui/QHBoxLayout>
+#include <QtGui/QHeaderView>
+#include <QtGui/QLabel>
+#include <QtGui/QPainter>
+#include <QtGui/QPushButton>
+#include <QtGui/QTableWidget>
+#include <QtGui/QVBoxLayout>
+
+#include <algorithm>
+#include <stdio.h>
+
+PerformanceSample::PerformanceSample()
+  : frame( 0 )
+  , bindingVersion( 0 )
+  , evaluationCount( 0 )
+  , executeMS( 0.0 )
+  , updateOutputsMS( 0.0 )
+  , redrawMS( 0.0 )
+{
+}
+
+// Stacked bars of the most recent samples, one pixel column per frame.
+class PerformanceGraph : public QWidget
+{
+public:
+
+  PerformanceGraph( PerformanceWidget const *samples, QWidget *parent = NULL )
+    : QWidget( parent )
+    , m_samples( samples )
+    , m_scaleMS( 1.0 )
+  {
+    setSizePolicy( QSizePolicy::Expanding, QSizePolicy::Fixed );
+    setMinimumSize( 100, 60 );
+  }
+
+  void setScale( double scaleMS )
+  {
+    m_scaleMS = scaleMS;
+  }
+
+  virtual QSize sizeHint() const
+  {
+    return QSize( 300, 60 );
+  }
+
+protected:
+
+  virtual void paintEvent( QPaintEvent *event )
+  {
+    QPainter painter( this );
+    painter.fillRect( rect(), palette().color( QPalette::Base ) );
+
+    size_t sampleCount = m_samples->sampleCount();
+    size_t barCount = std::min( sampleCount, size_t( width() ) );
+    double pixelsPerMS = double( height() ) / m_scaleMS;
+
+    QColor executeColor( 96, 160, 224 );
+    QColor updateOutputsColor( 128, 192, 96 );
+    QColor redrawColor( 224, 160, 64 );
+
+    for ( size_t i = 0; i < barCount; ++i )
+    {
+      PerformanceSample const &sample =
+        m_samples->sample( sampleCount - barCount + i );
+      int x = width() - int( barCount ) + int( i );
+      int y = height();
+
+      int executeHeight = int( sample.executeMS * pixelsPerMS );
+      painter.fillRect( x, y - executeHeight, 1, executeHeight, executeColor );
+      y -= executeHeight;
+
+      int updateOutputsHeight = int( sample.updateOutputsMS * pixelsPerMS );
+      painter.fillRect( x, y - updateOutputsHeight, 1, updateOutputsHeight, updateOutputsColor );
+      y -= updateOutputsHeight;
+
+      int redrawHeight = int( sample.redrawMS * pixelsPerMS );
+      painter.fillRect( x, y - redrawHeight, 1, redrawHeight, redrawColor );
+    }
+  }
+
+private:
+
+  PerformanceWidget const *m_samples;
+  double m_scaleMS;
+};
+
+PerformanceWidget::PerformanceWidget( QWidget *parent )
+  : QWidget( parent )
+  , m_nextSample( 0 )
+  , m_dirty( false )
+{
+  m_summaryLabel = new QLabel;
+
+  QStringList rowLabels;
+  rowLabels << "Execute" << "Update outputs" << "Redraw" << "Frame";
+  QStringList columnLabels;
+  columnLabels << "Last (ms)" << "p50" << "p95" << "p99";
+  m_table = new QTableWidget( rowLabels.size(), columnLabels.size() );
+  m_table->setVerticalHeaderLabels( rowLabels );
+  m_table->setHorizontalHeaderLabels( columnLabels );
+  m_table->setEditTriggers( QTableWidget::NoEditTriggers );
+  m_table->horizontalHeader()->setResizeMode( QHeaderView::Stretch );
+
+  m_graph = new PerformanceGraph( this );
+
+  QPushButton *clearButton = new QPushButton( "Clear" );
+  connect( clearButton, SIGNAL(clicked()), this, SLOT(clear()) );
+  QPushButton *exportButton = new QPushButton( "Export CSV..." );
+  connect( exportButton, SIGNAL(clicked()), this, SLOT(exportCSV()) );
+
+  QHBoxLayout *buttonsLayout = new QHBoxLayout;
+  buttonsLayout->addWidget( m_summaryLabel, 1 );
+  buttonsLayout->addWidget( clearButton );
+  buttonsLayout->addWidget( exportButton );
+
+  QVBoxLayout *layout = new QVBoxLayout( this );
+  layout->addLayout( buttonsLayout );
+  layout->addWidget( m_graph );
+  layout->addWidget( m_table );
+
+  m_refreshTimer.setInterval( 250 );
+  connect( &m_refreshTimer, SIGNAL(timeout()), this, SLOT(refresh()) );
+  m_refreshTimer.start();
+}
+
+void PerformanceWidget::addSample( PerformanceSample const &sample )
+{
+  if ( m_samples.size() < s_maxSampleCount )
+    m_samples.push_back( sample );
+  else
+  {
+    m_samples[m_nextSample] = sample;
+    m_nextSample = ( m_nextSample + 1 ) % s_maxSampleCount;
+  }
+  m_dirty = true;
+}
+
+PerformanceSample const &PerformanceWidget::sample( size_t index ) const
+{
+  return m_samples[( m_nextSample + index ) % m_samples.size()];
+}
+
+void PerformanceWidget::clear()
+{
+  m_samples.clear();
+  m_nextSample = 0;
+  m_dirty = true;
+  refresh();
+}
+
+void PerformanceWidget::showEvent( QShowEvent *event )
+{
+  QWidget::showEvent( event );
+  refresh();
+}
+
+static double Percentile( std::vector<double> &values, double fraction )
+{
+  if ( values.empty() )
+    return 0.0;
+  size_t index = size_t( fraction * double( values.size() - 1 ) + 0.5 );
+  std::nth_element( values.begin(), values.begin() + index, values.end() );
+  return values[index];
+}
+
+void PerformanceWidget::refresh()
+{
+  if ( !m_dirty || !isVisible() )
+    return;
+  m_dirty = false;
+
+  size_t sampleCount = m_samples.size();
+  std::vector<double> columns[4];
+  for ( size_t i = 0; i < 4; ++i )
+    columns[i].reserve( sampleCount );
+  for ( size_t i = 0; i < sampleCount; ++i )
+  {
+    PerformanceSample const &s = m_samples[i];
+    columns[0].push_back( s.executeMS );
+    columns[1].push_back( s.updateOutputsMS );
+    columns[2].push_back( s.redrawMS );
+    columns[3].push_back( s.totalMS() );
+  }
+
+  PerformanceSample last;
+  if ( sampleCount > 0 )
+    last = sample( sampleCount - 1 );
+  double lastValues[4] =
+  {
+    last.executeMS,
+    last.updateOutputsMS,
+    last.redrawMS,
+    last.totalMS()
+  };
+
+  for ( int row = 0; row < 4; ++row )
+  {
+    double values[4] =
+    {
+      lastValues[row],
+      Percentile( columns[row], 0.50 ),
+      Percentile( columns[row], 0.95 ),
+      Percentile( columns[row], 0.99 )
+    };
+    for ( int column = 0; column < 4; ++column )
+      m_table->setItem(
+        row, column,
+        new QTableWidgetItem( QString::number( values[column], 'f', 2 ) )
+        );
+  }
+
+  m_summaryLabel->setText(
+    QString( "Frame %1, binding version %2, %3 evaluation(s)" )
+      .arg( last.frame )
+      .arg( last.bindingVersion )
+      .arg( last.evaluationCount )
+    );
+
+  // scale the graph so that the slowest 1% of the frames clip
+  double scaleMS = Percentile( columns[3], 0.99 ) * 1.25;
+  m_graph->setScale( scaleMS > 1.0? scaleMS: 1.0 );
+  m_graph->update();
+}
+
+void PerformanceWidget::exportCSV()
+{
+  QString filePath = QFileDialog::getSaveFileName( this, "Export performance samples", "", "*.csv" );
+  if ( filePath.length() == 0 )
+    return;
+  if ( !filePath.toLower().endsWith( ".csv" ) )
+    filePath += ".csv";
+
+  FILE *file = fopen( filePath.toUtf8().constData(), "w" );
+  if ( !file )
+  {
+    printf("Error: unable to write %s\n", filePath.toUtf8().constData());
+    return;
+  }
+
+  fprintf( file, "frame,bindingVersion,evaluations,executeMS,updateOutputsMS,redrawMS,totalMS\n" );
+  for ( size_t i = 0; i < m_samples.size(); ++i )
+  {
+    PerformanceSample const &s = sample( i );
+    fprintf(
+      file,
+      "%d,%u,%u,%.4f,%.4f,%.4f,%.4f\n",
+      s.frame,
+      unsigned( s.bindingVersion ),
+      unsigned( s.evaluationCount ),
+      s.executeMS,
+      s.updateOutputsMS,
+      s.redrawMS,
+      s.totalMS()
+      );
+  }
+  fclose( file );
+}
@@ -0,0 +1,83 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_PERFORMANCE_H__
+#define __CANVAS_PERFORMANCE_H__
+
+#include <QtCore/QTimer>
+#include <QtGui/QWidget>
+
+#include <stdint.h>
+#include <vector>
+
+class QLabel;
+class QTableWidget;
+class PerformanceGraph;
+
+// Time spent on one displayed frame, from the evaluations that led to it
+// to the viewport redraw that showed it.
+struct PerformanceSample
+{
+  int frame;
+  uint32_t bindingVersion;
+  // evaluations completed for this frame; zero when the frame was
+  // served from the playback cache
+  uint32_t evaluationCount;
+  double executeMS;
+  double updateOutputsMS;
+  double redrawMS;
+
+  PerformanceSample();
+
+  double totalMS() const
+    { return executeMS + updateOutputsMS + redrawMS; }
+};
+
+// Keeps the last samples in a ring and shows the breakdown of the latest
+// frame next to the p50/p95/p99 of the whole window, so that a slowdown can
+// be attributed to the graph or to the UI. The display is refreshed a few
+// times per second, and only while the widget is visible.
+class PerformanceWidget : public QWidget
+{
+  Q_OBJECT
+
+public:
+
+  PerformanceWidget( QWidget *parent = NULL );
+
+  void addSample( PerformanceSample const &sample );
+
+  size_t sampleCount() const
+    { return m_samples.size(); }
+  // oldest first
+  PerformanceSample const &sample( size_t index ) const;
+
+public slots:
+
+  void clear();
+  void exportCSV();
+
+protected:
+
+  virtual void showEvent( QShowEvent *event );
+
+private slots:
+
+  void refresh();
+
+private:
+
+  static const size_t s_maxSampleCount = 1000;
+
+  std::vector<PerformanceSample> m_samples;
+  size_t m_nextSample;
+  bool m_dirty;
+  QTimer m_refreshTimer;
+
+  QLabel *m_summaryLabel;
+  QTableWidget *m_table;
+  PerformanceGraph *m_graph;
+};
+
+#endif // __CANVAS_PERFORMANCE_H__
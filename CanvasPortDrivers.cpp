@@ -0,0 +1,252 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasPortDrivers.h"
+
+PortDriverInputs::PortDriverInputs()
+  : fps( 24.0 )
+  , deltaTime( 1.0 / 24.0 )
+  , viewportWidth( 0 )
+  , viewportHeight( 0 )
+{
+}
+
+PortDriverRegistry::PortDriverRegistry()
+  : m_applied( false )
+{
+  for ( int i = 0; i < Driver_Count; ++i )
+    m_portNames[i] << DriverName( Driver( i ) );
+}
+
+char const *PortDriverRegistry::DriverName( Driver driver )
+{
+  switch ( driver )
+  {
+    case Driver_FPS:
+      return "fps";
+    case Driver_DeltaTime:
+      return "deltaTime";
+    case Driver_ViewportSize:
+      return "viewportSize";
+    case Driver_CameraMatrix:
+      return "cameraMatrix";
+    case Driver_Count:
+      break;
+  }
+  return "";
+}
+
+unsigned PortDriverRegistry::AcceptedTypes( Driver driver )
+{
+  switch ( driver )
+  {
+    case Driver_FPS:
+    case Driver_DeltaTime:
+      return ValueType_SInt32 | ValueType_UInt32
+        | ValueType_Float32 | ValueType_Float64;
+    case Driver_ViewportSize:
+      return ValueType_Vec2;
+    case Driver_CameraMatrix:
+      return ValueType_Mat44;
+    case Driver_Count:
+      break;
+  }
+  return 0;
+}
+
+void PortDriverRegistry::configure( QSettings *settings )
+{
+  // a comma separated list of port names; empty disables the driver
+  for ( int i = 0; i < Driver_Count; ++i )
+  {
+    QString key = QString( "portDrivers/" ) + DriverName( Driver( i ) );
+    m_portNames[i] =
+      settings->value( key, DriverName( Driver( i ) ) ).toString()
+        .split( ',', QString::SkipEmptyParts );
+  }
+}
+
+void PortDriverRegistry::reset()
+{
+  m_boundPorts.clear();
+  m_applied = false;
+}
+
+bool PortDriverRegistry::dependsOnView() const
+{
+  for ( size_t i = 0; i < m_boundPorts.size(); ++i )
+  {
+    if ( m_boundPorts[i].driver == Driver_ViewportSize
+      || m_boundPorts[i].driver == Driver_CameraMatrix )
+      return true;
+  }
+  return false;
+}
+
+PortDriverRegistry::ValueType PortDriverRegistry::ResolveType(
+  FabricCore::DFGExec &exec,
+  unsigned index,
+  unsigned acceptedTypes
+  )
+{
+  static const struct
+  {
+    ValueType type;
+    char const *name;
+  } types[] =
+  {
+    { ValueType_SInt32, "SInt32" },
+    { ValueType_UInt32, "UInt32" },
+    { ValueType_Float32, "Float32" },
+    { ValueType_Float64, "Float64" },
+    { ValueType_Vec2, "Vec2" },
+    { ValueType_Mat44, "Mat44" }
+  };
+
+  // only the types the driver accepts are compared
+  for ( size_t i = 0; i < sizeof( types ) / sizeof( types[0] ); ++i )
+  {
+    if ( ( acceptedTypes & types[i].type )
+      && exec.isExecPortResolvedType( index, types[i].name ) )
+      return types[i].type;
+  }
+  return ValueType( 0 );
+}
+
+void PortDriverRegistry::resolve(
+  FabricCore::DFGExec &exec,
+  RootPortMap &ports
+  )
+{
+  reset();
+
+  for ( int i = 0; i < Driver_Count; ++i )
+  {
+    Driver driver = Driver( i );
+
+    // the graph can name its own ports
+    QStringList portNames = m_portNames[i];
+    std::string metadataKey = std::string( "portDriver_" ) + DriverName( driver );
+    QString metadataPortNames = exec.getMetadata( metadataKey.c_str() );
+    if ( !metadataPortNames.isEmpty() )
+      portNames = metadataPortNames.split( ',', QString::SkipEmptyParts );
+
+    for ( int j = 0; j < portNames.size(); ++j )
+    {
+      int index = ports.findInput(
+        exec, portNames[j].trimmed().toUtf8().constData()
+        );
+      if ( index < 0 )
+        continue;
+      ValueType type =
+        ResolveType( exec, unsigned( index ), AcceptedTypes( driver ) );
+      if ( type == ValueType( 0 ) )
+        continue;
+
+      BoundPort boundPort;
+      boundPort.driver = driver;
+      boundPort.index = unsigned( index );
+      boundPort.type = type;
+      m_boundPorts.push_back( boundPort );
+    }
+  }
+}
+
+FabricCore::RTVal PortDriverRegistry::ConstructScalar(
+  FabricCore::Client const &client,
+  ValueType type,
+  double value
+  )
+{
+  switch ( type )
+  {
+    case ValueType_SInt32:
+      return FabricCore::RTVal::ConstructSInt32( client, int32_t( value ) );
+    case ValueType_UInt32:
+      return FabricCore::RTVal::ConstructUInt32( client, uint32_t( value ) );
+    case ValueType_Float32:
+      return FabricCore::RTVal::ConstructFloat32( client, float( value ) );
+    default:
+      return FabricCore::RTVal::ConstructFloat64( client, value );
+  }
+}
+
+bool PortDriverRegistry::apply(
+  FabricCore::Client const &client,
+  GraphExecutor &executor,
+  FabricCore::DFGBinding const &binding,
+  PortDriverInputs const &inputs
+  )
+{
+  bool changed = !m_applied;
+  for ( size_t i = 0; i < m_boundPorts.size() && !changed; ++i )
+  {
+    switch ( m_boundPorts[i].driver )
+    {
+      case Driver_FPS:
+        changed = inputs.fps != m_appliedInputs.fps;
+        break;
+      case Driver_DeltaTime:
+        changed = inputs.deltaTime != m_appliedInputs.deltaTime;
+        break;
+      case Driver_ViewportSize:
+        changed = inputs.viewportWidth != m_appliedInputs.viewportWidth
+          || inputs.viewportHeight != m_appliedInputs.viewportHeight;
+        break;
+      case Driver_CameraMatrix:
+        // not compared; the camera moves outside the timeline anyway
+        changed = true;
+        break;
+      case Driver_Count:
+        break;
+    }
+  }
+  m_applied = true;
+  m_appliedInputs = inputs;
+
+  // the vector values are built at most once, whatever the number of
+  // ports they are bound to
+  FabricCore::RTVal viewportSize;
+  FabricCore::RTVal cameraMatrix;
+
+  for ( size_t i = 0; i < m_boundPorts.size(); ++i )
+  {
+    BoundPort const &boundPort = m_boundPorts[i];
+    FabricCore::RTVal value;
+    switch ( boundPort.driver )
+    {
+      case Driver_FPS:
+        value = ConstructScalar( client, boundPort.type, inputs.fps );
+        break;
+      case Driver_DeltaTime:
+        value = ConstructScalar( client, boundPort.type, inputs.deltaTime );
+        break;
+      case Driver_ViewportSize:
+        if ( !viewportSize.isValid() )
+        {
+          FabricCore::RTVal size[2] =
+          {
+            FabricCore::RTVal::ConstructFloat32( client, float( inputs.viewportWidth ) ),
+            FabricCore::RTVal::ConstructFloat32( client, float( inputs.viewportHeight ) )
+          };
+          viewportSize = FabricCore::RTVal::Construct( client, "Vec2", 2, size );
+        }
+        value = viewportSize;
+        break;
+      case Driver_CameraMatrix:
+        if ( !cameraMatrix.isValid() && inputs.camera.isValid() )
+        {
+          FabricCore::RTVal camera = inputs.camera;
+          cameraMatrix = camera.callMethod( "Mat44", "getMat44", 0, 0 );
+        }
+        value = cameraMatrix;
+        break;
+      case Driver_Count:
+        break;
+    }
+    if ( value.isValid() )
+      executor.setArgValue( binding, unsigned( boundPort.index ), value );
+  }
+  return changed;
+}
@@ -0,0 +1,115 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_PORT_DRIVERS_H__
+#define __CANVAS_PORT_DRIVERS_H__
+
+#include "CanvasExecutor.h"
+#include "CanvasPorts.h"
+
+#include <FabricCore.h>
+
+#include <QtCore/QSettings>
+#include <QtCore/QStringList>
+
+#include <vector>
+
+// The values the drivers push into the graph for one evaluation.
+struct PortDriverInputs
+{
+  double fps;
+  // seconds since the previously driven frame
+  double deltaTime;
+  int viewportWidth;
+  int viewportHeight;
+  FabricCore::RTVal camera;
+
+  PortDriverInputs();
+};
+
+// Drives root input ports from the application state, like the timeline
+// port follows the current frame. Each driver binds to the ports named in
+// the portDrivers/<driver> setting, or in the portDriver_<driver> metadata
+// of the graph, when their resolved type is one it accepts. The binding
+// happens once per structure change; apply() then sets every bound port
+// without any lookup.
+class PortDriverRegistry
+{
+public:
+
+  enum Driver
+  {
+    Driver_FPS,
+    Driver_DeltaTime,
+    Driver_ViewportSize,
+    Driver_CameraMatrix,
+    Driver_Count
+  };
+
+  PortDriverRegistry();
+
+  // reads the port names of each driver
+  void configure( QSettings *settings );
+
+  void resolve( FabricCore::DFGExec &exec, RootPortMap &ports );
+  void reset();
+
+  bool hasBoundPorts() const
+    { return !m_boundPorts.empty(); }
+  // true if a bound port follows the viewport, whose changes do not go
+  // through the timeline
+  bool dependsOnView() const;
+
+  // sets all the bound ports without undo records; their dirty
+  // notifications are merged into a single evaluation. returns true if
+  // a value differs from the ones set by the previous call, ie. if the
+  // results of the frames evaluated before are outdated
+  bool apply(
+    FabricCore::Client const &client,
+    GraphExecutor &executor,
+    FabricCore::DFGBinding const &binding,
+    PortDriverInputs const &inputs
+    );
+
+  static char const *DriverName( Driver driver );
+
+private:
+
+  enum ValueType
+  {
+    ValueType_SInt32  = 1 << 0,
+    ValueType_UInt32  = 1 << 1,
+    ValueType_Float32 = 1 << 2,
+    ValueType_Float64 = 1 << 3,
+    ValueType_Vec2    = 1 << 4,
+    ValueType_Mat44   = 1 << 5
+  };
+
+  struct BoundPort
+  {
+    Driver driver;
+    unsigned index;
+    ValueType type;
+  };
+
+  static unsigned AcceptedTypes( Driver driver );
+  static ValueType ResolveType(
+    FabricCore::DFGExec &exec,
+    unsigned index,
+    unsigned acceptedTypes
+    );
+  static FabricCore::RTVal ConstructScalar(
+    FabricCore::Client const &client,
+    ValueType type,
+    double value
+    );
+
+  QStringList m_portNames[Driver_Count];
+  std::vector<BoundPort> m_boundPorts;
+  // the inputs of the previous apply(), if any since the last reset()
+  bool m_applied;
+  PortDriverInputs m_appliedInputs;
+};
+
+#endif // __CANVAS_PORT_DRIVERS_H__
@@ -0,0 +1,127 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasPorts.h"
+
+#include <FTL/CStrRef.h>
+
+#include <string.h>
+
+RootPortMap::RootPortMap()
+  : m_portCount( 0 )
+  , m_isStale( true )
+{
+}
+
+QByteArray RootPortMap::Key( char const *name )
+{
+  return QByteArray::fromRawData( name, int( strlen( name ) ) );
+}
+
+void RootPortMap::clear()
+{
+  m_portCount = 0;
+  m_isStale = true;
+  m_ports.clear();
+}
+
+void RootPortMap::rebuild( FabricCore::DFGExec &exec )
+{
+  m_ports.clear();
+
+  m_portCount = exec.getExecPortCount();
+  m_ports.reserve( int( m_portCount ) );
+  for ( unsigned i = 0; i < m_portCount; ++i )
+  {
+    FTL::CStrRef portName = exec.getExecPortName( i );
+    Port port;
+    port.index = i;
+    port.isInput = exec.getExecPortType( i ) != FabricCore::DFGPortType_Out;
+    m_ports.insert(
+      QByteArray( portName.data(), int( portName.size() ) ),
+      port
+      );
+  }
+  m_isStale = false;
+}
+
+void RootPortMap::onPortAdded(
+  FabricCore::DFGExec &exec,
+  char const *name,
+  FabricCore::DFGPortType portType
+  )
+{
+  if ( m_isStale )
+    return;
+
+  // new ports are appended
+  Port port;
+  port.index = m_portCount;
+  port.isInput = portType != FabricCore::DFGPortType_Out;
+  if ( exec.getExecPortCount() != m_portCount + 1
+    || strcmp( exec.getExecPortName( port.index ), name ) != 0 )
+  {
+    m_isStale = true;
+    return;
+  }
+  m_ports.insert( QByteArray( name ), port );
+  ++m_portCount;
+}
+
+void RootPortMap::onPortRemoved( char const *name )
+{
+  if ( m_isStale )
+    return;
+
+  QHash<QByteArray, Port>::iterator it = m_ports.find( Key( name ) );
+  if ( it == m_ports.end() )
+  {
+    m_isStale = true;
+    return;
+  }
+  unsigned index = it->index;
+  m_ports.erase( it );
+  --m_portCount;
+
+  // the following ports move down
+  for ( it = m_ports.begin(); it != m_ports.end(); ++it )
+  {
+    if ( it->index > index )
+      --it->index;
+  }
+}
+
+void RootPortMap::onPortRenamed( char const *oldName, char const *newName )
+{
+  if ( m_isStale )
+    return;
+
+  QHash<QByteArray, Port>::iterator it = m_ports.find( Key( oldName ) );
+  if ( it == m_ports.end() )
+  {
+    m_isStale = true;
+    return;
+  }
+  Port port = *it;
+  m_ports.erase( it );
+  m_ports.insert( QByteArray( newName ), port );
+}
+
+int RootPortMap::findInput( FabricCore::DFGExec &exec, char const *name )
+{
+  if ( m_isStale || exec.getExecPortCount() != m_portCount )
+    rebuild( exec );
+
+  QHash<QByteArray, Port>::const_iterator it = m_ports.constFind( Key( name ) );
+  if ( it != m_ports.constEnd()
+    && strcmp( exec.getExecPortName( it->index ), name ) != 0 )
+  {
+    // the ports were reordered or renamed behind the map's back
+    rebuild( exec );
+    it = m_ports.constFind( Key( name ) );
+  }
+  if ( it == m_ports.constEnd() || !it->isInput )
+    return -1;
+  return int( it->index );
+}
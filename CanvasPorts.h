@@ -0,0 +1,62 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_PORTS_H__
+#define __CANVAS_PORTS_H__
+
+#include <FabricCore.h>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+
+// Name to index map of the root exec ports. The command handler patches
+// it as the root ports are added, removed or renamed, so that a script
+// adding hundreds of ports costs a hash update per port; any change it
+// cannot follow (an undo, a redo, a new graph) marks it stale, and it is
+// then rebuilt in a single pass by the next lookup. Finding one of the
+// special ports (the timeline, the port drivers) is a hash lookup rather
+// than a scan with a name comparison per port.
+class RootPortMap
+{
+public:
+
+  RootPortMap();
+
+  void rebuild( FabricCore::DFGExec &exec );
+  // marks the map stale
+  void clear();
+
+  bool isStale() const
+    { return m_isStale; }
+
+  // the root exec commands the map follows; called once they are done
+  void onPortAdded(
+    FabricCore::DFGExec &exec,
+    char const *name,
+    FabricCore::DFGPortType portType
+    );
+  void onPortRemoved( char const *name );
+  void onPortRenamed( char const *oldName, char const *newName );
+
+  // -1 if the exec has no input (or IO) port with that name. The map is
+  // rebuilt first if it is stale or does not match the exec.
+  int findInput( FabricCore::DFGExec &exec, char const *name );
+
+private:
+
+  struct Port
+  {
+    unsigned index;
+    bool isInput;
+  };
+
+  // wraps the name without copying it
+  static QByteArray Key( char const *name );
+
+  unsigned m_portCount;
+  bool m_isStale;
+  QHash<QByteArray, Port> m_ports;
+};
+
+#endif // __CANVAS_PORTS_H__
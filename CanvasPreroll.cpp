@@ -0,0 +1,289 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasPreroll.h"
+#include "CanvasTrace.h"
+
+#include <QtCore/QtConcurrentRun>
+
+#include <stdio.h>
+
+FramePreroller::FramePreroller(
+  FabricCore::Client const &client,
+  FrameCache *cache,
+  unsigned workerCount,
+  unsigned lookAheadFrameCount,
+  QObject *parent
+  )
+  : QObject( parent )
+  , m_client( client )
+  , m_jsonGeneration( 0 )
+  , m_readsEvalContext( false )
+  , m_drawsInline( false )
+  , m_waitingForGraph( false )
+  , m_cache( cache )
+  , m_lookAheadFrameCount( lookAheadFrameCount )
+  , m_generation( 0 )
+{
+  m_workers.resize( workerCount );
+  for ( size_t i = 0; i < m_workers.size(); ++i )
+  {
+    Worker &worker = m_workers[i];
+    worker.generation = 0;
+    worker.frame = 0;
+    worker.busy = false;
+    worker.watcher = new QFutureWatcher<PrerollResult>( this );
+    connect(
+      worker.watcher, SIGNAL(finished()),
+      this, SLOT(onJobFinished())
+      );
+  }
+}
+
+FramePreroller::~FramePreroller()
+{
+  release();
+}
+
+void FramePreroller::invalidate( uint32_t generation )
+{
+  m_generation = generation;
+
+  // the busy clones are freed once their evaluation completes
+  for ( size_t i = 0; i < m_workers.size(); ++i )
+  {
+    if ( !m_workers[i].busy )
+      m_workers[i].binding = FabricCore::DFGBinding();
+  }
+}
+
+void FramePreroller::release()
+{
+  for ( size_t i = 0; i < m_workers.size(); ++i )
+  {
+    Worker &worker = m_workers[i];
+    worker.watcher->waitForFinished();
+    worker.busy = false;
+    worker.binding = FabricCore::DFGBinding();
+  }
+  m_json.clear();
+  m_waitingForGraph = false;
+}
+
+void FramePreroller::setGraph(
+  FabricCore::DFGHost &host,
+  FabricCore::DFGBinding &binding
+  )
+{
+  m_waitingForGraph = false;
+
+  try
+  {
+    FabricCore::DFGStringResult jsonResult = binding.exportJSON();
+    char const *jsonData;
+    uint32_t jsonSize;
+    jsonResult.getStringDataAndLength( jsonData, jsonSize );
+    m_json.assign( jsonData, jsonSize );
+  }
+  catch ( FabricCore::Exception e )
+  {
+    printf("Exception: %s\n", e.getDesc_cstr());
+    m_json.clear();
+    return;
+  }
+
+  m_host = host;
+  m_jsonGeneration = m_generation;
+
+  // the EvalContext and the inline drawing are singletons: a clone reading
+  // the time would get the one of the frame on screen, and a clone drawing
+  // would write into the shapes the viewport is rendering. the timeline
+  // port is the only source of time a pre-rolled graph may use.
+  try
+  {
+    FabricCore::DFGExec exec = binding.getExec();
+    GraphUsage usage = FindGraphUsage( exec );
+    m_readsEvalContext = usage.readsEvalContext;
+    m_drawsInline = usage.drawsInline;
+  }
+  catch ( FabricCore::Exception e )
+  {
+    printf("Exception: %s\n", e.getDesc_cstr());
+    m_json.clear();
+  }
+}
+
+bool FramePreroller::isScheduled( int frame ) const
+{
+  for ( size_t i = 0; i < m_workers.size(); ++i )
+  {
+    Worker const &worker = m_workers[i];
+    if ( worker.busy
+      && worker.generation == m_generation
+      && worker.frame == frame )
+      return true;
+  }
+  return false;
+}
+
+void FramePreroller::request(
+  TimelinePort const &timelinePort,
+  int frame,
+  int rangeStart,
+  int rangeEnd,
+  bool loop
+  )
+{
+  if ( !timelinePort.isSet() || rangeEnd < rangeStart )
+    return;
+
+  // the graph is exported after its next evaluation, out of the frame change
+  if ( m_json.empty() || m_jsonGeneration != m_generation )
+  {
+    m_waitingForGraph = true;
+    return;
+  }
+  if ( m_readsEvalContext || m_drawsInline )
+    return;
+
+  for ( unsigned i = 1; i <= m_lookAheadFrameCount; ++i )
+  {
+    int aheadFrame = frame + int( i );
+    if ( aheadFrame > rangeEnd )
+    {
+      if ( !loop )
+        break;
+      aheadFrame =
+        rangeStart + ( aheadFrame - rangeEnd - 1 ) % ( rangeEnd - rangeStart + 1 );
+    }
+    // the range is shorter than the look-ahead
+    if ( aheadFrame == frame )
+      break;
+
+    if ( m_cache->contains( m_generation, aheadFrame )
+      || isScheduled( aheadFrame ) )
+      continue;
+
+    Worker *worker = NULL;
+    for ( size_t j = 0; j < m_workers.size(); ++j )
+    {
+      if ( !m_workers[j].busy )
+      {
+        worker = &m_workers[j];
+        break;
+      }
+    }
+    if ( !worker )
+      break;
+
+    PrerollJob job;
+    // the clone is made by the worker thread
+    if ( !worker->binding || worker->generation != m_generation )
+    {
+      job.json = m_json;
+      job.host = m_host;
+      worker->binding = FabricCore::DFGBinding();
+      worker->generation = m_generation;
+    }
+    job.binding = worker->binding;
+    job.generation = m_generation;
+    // keeps the worker's value unless the port changed
+    worker->timelinePort = timelinePort;
+    job.timelinePort = &worker->timelinePort;
+    job.frame = aheadFrame;
+
+    worker->frame = aheadFrame;
+    worker->busy = true;
+    worker->watcher->setFuture(
+      QtConcurrent::run( this, &FramePreroller::evaluate, job )
+      );
+  }
+}
+
+void FramePreroller::onJobFinished()
+{
+  for ( size_t i = 0; i < m_workers.size(); ++i )
+  {
+    Worker &worker = m_workers[i];
+    if ( !worker.busy || !worker.watcher->isFinished() )
+      continue;
+    worker.busy = false;
+
+    if ( worker.generation != m_generation )
+    {
+      worker.binding = FabricCore::DFGBinding();
+      continue;
+    }
+
+    PrerollResult result = worker.watcher->result();
+    if ( result.binding )
+      worker.binding = result.binding;
+    if ( !result.succeeded || result.generation != m_generation )
+      continue;
+
+    m_cache->insert( result.generation, result.frame, result.values );
+    emit frameCached( result.frame );
+  }
+}
+
+PrerollResult FramePreroller::evaluate( PrerollJob job )
+{
+  CANVAS_TRACE_SCOPE( "preroll" );
+
+  PrerollResult result;
+  result.generation = job.generation;
+  result.frame = job.frame;
+  result.succeeded = false;
+
+  try
+  {
+    if ( !job.json.empty() )
+    {
+      job.binding = job.host.createBindingFromJSON( job.json.c_str() );
+      BindUnboundArgs( m_client, job.binding );
+      result.binding = job.binding;
+    }
+
+    job.timelinePort->setFrame( m_client, job.binding, job.frame );
+    job.binding.execute();
+
+    result.succeeded =
+      CopyFrameOutputs( m_client, job.binding, result.values );
+  }
+  catch ( FabricCore::Exception e )
+  {
+    printf("Exception: %s\n", e.getDesc_cstr());
+  }
+
+  return result;
+}
+
+void FramePreroller::BindUnboundArgs(
+  FabricCore::Client const &client,
+  FabricCore::DFGBinding &binding
+  )
+{
+  // a new binding has no values for its arguments; give the inputs the
+  // default value of their type, as the UI does for the edited binding
+  FabricCore::DFGExec exec = binding.getExec();
+  for ( unsigned i = 0; i < exec.getExecPortCount(); ++i )
+  {
+    if ( exec.getExecPortType( i ) == FabricCore::DFGPortType_Out )
+      continue;
+
+    FabricCore::RTVal value = binding.getArgValue( i );
+    if ( value.isValid() )
+      continue;
+
+    char const *resolvedType = exec.getExecPortResolvedType( i );
+    if ( !resolvedType || !resolvedType[0] )
+      continue;
+
+    binding.setArgValue(
+      i,
+      FabricCore::RTVal::Construct( client, resolvedType, 0, NULL ),
+      false
+      );
+  }
+}
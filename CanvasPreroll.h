@@ -0,0 +1,134 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_PREROLL_H__
+#define __CANVAS_PREROLL_H__
+
+#include <FabricCore.h>
+
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QObject>
+
+#include <string>
+#include <vector>
+
+#include "CanvasFrameCache.h"
+#include "CanvasTimeline.h"
+
+struct PrerollJob
+{
+  // the graph to clone when the worker has no up to date copy of it
+  std::string json;
+  FabricCore::DFGHost host;
+  FabricCore::DFGBinding binding;
+  uint32_t generation;
+  // owned by the worker, so that its value is not shared between threads
+  TimelinePort *timelinePort;
+  int frame;
+};
+
+struct PrerollResult
+{
+  FabricCore::DFGBinding binding;
+  uint32_t generation;
+  int frame;
+  bool succeeded;
+  std::vector<FrameCacheValue> values;
+};
+
+// Evaluates the frames that follow the current one ahead of time, while the
+// current frame is on screen. Each worker evaluates its own copy of the graph,
+// cloned from the edited binding, so the look-ahead never touches the binding
+// shown in the UI; the outputs end up in the frame cache. Only graphs without
+// simulation can be pre-rolled, since a simulated frame depends on the
+// previous one. The clones are made on the worker threads from a JSON copy of
+// the graph, exported once per generation with setGraph. Graphs that read the
+// EvalContext or draw inline are not pre-rolled, since both are shared by
+// every binding; see FindGraphUsage.
+class FramePreroller : public QObject
+{
+  Q_OBJECT
+
+public:
+
+  FramePreroller(
+    FabricCore::Client const &client,
+    FrameCache *cache,
+    unsigned workerCount,
+    unsigned lookAheadFrameCount,
+    QObject *parent = NULL
+    );
+  ~FramePreroller();
+
+  // the cloned graphs belong to the previous generation: they are replaced
+  // the next time they are needed, and the results still in flight are
+  // dropped
+  void invalidate( uint32_t generation );
+
+  // true once a request found no copy of the current generation of the graph
+  bool isWaitingForGraph() const
+    { return m_waitingForGraph; }
+
+  // exports binding, which must be the graph of the current generation and
+  // must not be executing, as the source of the clones
+  void setGraph(
+    FabricCore::DFGHost &host,
+    FabricCore::DFGBinding &binding
+    );
+
+  // schedules the frames following frame that are not cached yet
+  void request(
+    TimelinePort const &timelinePort,
+    int frame,
+    int rangeStart,
+    int rangeEnd,
+    bool loop
+    );
+
+  // waits for the running evaluations and frees the cloned graphs
+  void release();
+
+signals:
+
+  void frameCached( int frame );
+
+private slots:
+
+  void onJobFinished();
+
+private:
+
+  struct Worker
+  {
+    FabricCore::DFGBinding binding;
+    TimelinePort timelinePort;
+    uint32_t generation;
+    int frame;
+    bool busy;
+    QFutureWatcher<PrerollResult> *watcher;
+  };
+
+  bool isScheduled( int frame ) const;
+
+  PrerollResult evaluate( PrerollJob job );
+
+  static void BindUnboundArgs(
+    FabricCore::Client const &client,
+    FabricCore::DFGBinding &binding
+    );
+
+  FabricCore::Client m_client;
+  FabricCore::DFGHost m_host;
+  std::string m_json;
+  uint32_t m_jsonGeneration;
+  bool m_readsEvalContext;
+  bool m_drawsInline;
+  bool m_waitingForGraph;
+  FrameCache *m_cache;
+  unsigned m_lookAheadFrameCount;
+  uint32_t m_generation;
+  std::vector<Worker> m_workers;
+};
+
+#endif // __CANVAS_PREROLL_H__
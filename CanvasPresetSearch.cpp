@@ -0,0 +1,445 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasPresetSearch.h"
+#include "CanvasTrace.h"
+
+#include <FTL/JSONValue.h>
+#include <FTL/OwnedPtr.h>
+
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFileInfo>
+#include <QtGui/QLabel>
+#include <QtGui/QLineEdit>
+#include <QtGui/QListWidget>
+#include <QtGui/QVBoxLayout>
+
+#include <algorithm>
+#include <ctype.h>
+#include <iterator>
+#include <stdio.h>
+
+PresetSearchIndex::PresetSearchIndex()
+{
+}
+
+void PresetSearchIndex::clear()
+{
+  m_pendingNamespaces.clear();
+  m_entries.clear();
+  m_entryIndices.clear();
+  m_postings.clear();
+}
+
+uint32_t PresetSearchIndex::Trigram( char const *chars )
+{
+  return ( uint32_t( (unsigned char)chars[0] ) << 16 )
+    | ( uint32_t( (unsigned char)chars[1] ) << 8 )
+    | uint32_t( (unsigned char)chars[2] );
+}
+
+static std::string ToLower( std::string const &value )
+{
+  std::string result( value );
+  for ( size_t i = 0; i < result.size(); ++i )
+    result[i] = char( tolower( (unsigned char)result[i] ) );
+  return result;
+}
+
+void PresetSearchIndex::beginBuild()
+{
+  clear();
+  m_pendingNamespaces.push_back( std::string() );
+}
+
+bool PresetSearchIndex::buildStep( FabricCore::DFGHost &host )
+{
+  if ( m_pendingNamespaces.empty() )
+    return false;
+
+  CANVAS_TRACE_SCOPE( "buildPresetIndexStep" );
+
+  std::string namespacePath = m_pendingNamespaces.back();
+  m_pendingNamespaces.pop_back();
+  try
+  {
+    walk( host, namespacePath );
+  }
+  catch ( FabricCore::Exception e )
+  {
+    printf("Exception: %s\n", e.getDesc_cstr());
+  }
+  catch ( FTL::JSONException e )
+  {
+    FTL::StrRef desc = e.getDesc();
+    printf(
+      "Error: unable to parse the preset library: %.*s\n",
+      int( desc.size() ),
+      desc.data()
+      );
+  }
+  return !m_pendingNamespaces.empty();
+}
+
+void PresetSearchIndex::walk(
+  FabricCore::DFGHost &host,
+  std::string const &namespacePath
+  )
+{
+  FabricCore::DFGStringResult descResult =
+    host.getPresetDesc( namespacePath.c_str() );
+  char const *descData;
+  uint32_t descSize;
+  descResult.getStringDataAndLength( descData, descSize );
+
+  FTL::JSONStrWithLoc descStr( FTL::StrRef( descData, descSize ) );
+  FTL::OwnedPtr<FTL::JSONObject> descObject(
+    FTL::JSONObject::Decode( descStr )
+    );
+  FTL::JSONObject const *membersObject =
+    descObject->maybeGetObject( FTL_STR("members") );
+  if ( !membersObject )
+    return;
+
+  for ( FTL::JSONObject::const_iterator it = membersObject->begin();
+    it != membersObject->end(); ++it )
+  {
+    std::string memberPath = namespacePath;
+    if ( !memberPath.empty() )
+      memberPath += '.';
+    memberPath += it->first;
+
+    FTL::JSONObject const *memberObject = it->second->cast_object();
+    if ( !memberObject )
+      continue;
+    std::string objectType =
+      memberObject->getStringOrEmpty( FTL_STR("objectType") );
+    if ( objectType == "Namespace" )
+      m_pendingNamespaces.push_back( memberPath );
+    else if ( objectType == "Preset" )
+      addPreset( memberPath );
+  }
+}
+
+void PresetSearchIndex::addPreset( std::string const &presetPath )
+{
+  if ( presetPath.empty()
+    || m_entryIndices.find( presetPath ) != m_entryIndices.end() )
+    return;
+
+  uint32_t entryIndex = uint32_t( m_entries.size() );
+  m_entries.push_back( Entry() );
+  Entry &entry = m_entries.back();
+  entry.path = presetPath;
+  entry.text = ToLower( presetPath );
+  size_t lastDot = presetPath.rfind( '.' );
+  entry.nameOffset = lastDot == std::string::npos? 0: lastDot + 1;
+  m_entryIndices[presetPath] = entryIndex;
+
+  // entries are only appended, so the postings stay sorted
+  for ( size_t i = 0; i + 3 <= entry.text.size(); ++i )
+  {
+    std::vector<uint32_t> &posting = m_postings[Trigram( &entry.text[i] )];
+    if ( posting.empty() || posting.back() != entryIndex )
+      posting.push_back( entryIndex );
+  }
+}
+
+int PresetSearchIndex::score(
+  Entry const &entry,
+  std::vector<std::string> const &words
+  ) const
+{
+  int result = 0;
+  for ( size_t i = 0; i < words.size(); ++i )
+  {
+    std::string const &word = words[i];
+    size_t namePos = entry.text.find( word, entry.nameOffset );
+    if ( namePos == entry.nameOffset )
+    {
+      result += 4;
+      if ( entry.text.size() - entry.nameOffset == word.size() )
+        result += 8;
+    }
+    else if ( namePos != std::string::npos )
+      result += 2;
+  }
+  return result;
+}
+
+namespace {
+
+struct SearchResult
+{
+  int score;
+  std::string const *path;
+
+  bool operator<( SearchResult const &other ) const
+  {
+    if ( score != other.score )
+      return score > other.score;
+    if ( path->size() != other.path->size() )
+      return path->size() < other.path->size();
+    return *path < *other.path;
+  }
+};
+
+}
+
+void PresetSearchIndex::search(
+  std::string const &query,
+  size_t maxResultCount,
+  std::vector<std::string> &presetPaths
+  ) const
+{
+  presetPaths.clear();
+
+  std::vector<std::string> words;
+  std::string lowerQuery = ToLower( query );
+  size_t wordStart = 0;
+  while ( wordStart < lowerQuery.size() )
+  {
+    size_t wordEnd = lowerQuery.find( ' ', wordStart );
+    if ( wordEnd == std::string::npos )
+      wordEnd = lowerQuery.size();
+    if ( wordEnd > wordStart )
+      words.push_back( lowerQuery.substr( wordStart, wordEnd - wordStart ) );
+    wordStart = wordEnd + 1;
+  }
+  if ( words.empty() )
+    return;
+
+  // the postings of every trigram of the query, shortest first
+  std::vector< std::vector<uint32_t> const * > postings;
+  for ( size_t i = 0; i < words.size(); ++i )
+  {
+    std::string const &word = words[i];
+    for ( size_t j = 0; j + 3 <= word.size(); ++j )
+    {
+      std::map< uint32_t, std::vector<uint32_t> >::const_iterator it =
+        m_postings.find( Trigram( &word[j] ) );
+      if ( it == m_postings.end() )
+        return;
+      postings.push_back( &it->second );
+    }
+  }
+
+  std::vector<uint32_t> candidates;
+  if ( postings.empty() )
+  {
+    // words shorter than a trigram: verify every entry
+    candidates.reserve( m_entries.size() );
+    for ( uint32_t i = 0; i < m_entries.size(); ++i )
+      candidates.push_back( i );
+  }
+  else
+  {
+    for ( size_t i = 1; i < postings.size(); ++i )
+    {
+      for ( size_t j = i; j > 0 && postings[j]->size() < postings[j - 1]->size(); --j )
+        std::swap( postings[j], postings[j - 1] );
+    }
+
+    candidates = *postings[0];
+    for ( size_t i = 1; i < postings.size() && !candidates.empty(); ++i )
+    {
+      std::vector<uint32_t> intersection;
+      std::set_intersection(
+        candidates.begin(), candidates.end(),
+        postings[i]->begin(), postings[i]->end(),
+        std::back_inserter( intersection )
+        );
+      candidates.swap( intersection );
+    }
+  }
+
+  // the trigrams match; check that each word is present as a whole
+  std::vector<SearchResult> results;
+  for ( size_t i = 0; i < candidates.size(); ++i )
+  {
+    Entry const &entry = m_entries[candidates[i]];
+
+    bool matches = true;
+    for ( size_t j = 0; j < words.size() && matches; ++j )
+      matches = entry.text.find( words[j] ) != std::string::npos;
+    if ( !matches )
+      continue;
+
+    SearchResult result;
+    result.score = score( entry, words );
+    result.path = &entry.path;
+    results.push_back( result );
+  }
+
+  size_t resultCount = std::min( results.size(), maxResultCount );
+  std::partial_sort(
+    results.begin(), results.begin() + resultCount, results.end()
+    );
+  presetPaths.reserve( resultCount );
+  for ( size_t i = 0; i < resultCount; ++i )
+    presetPaths.push_back( *results[i].path );
+}
+
+PresetSearchWidget::PresetSearchWidget(
+  FabricCore::DFGHost const &host,
+  QWidget *parent
+  )
+  : QWidget( parent )
+  , m_host( host )
+  , m_browser( NULL )
+{
+  m_buildTimer.setInterval( 0 );
+  connect( &m_buildTimer, SIGNAL(timeout()), this, SLOT(buildSlice()) );
+
+  m_queryEdit = new QLineEdit;
+  m_queryEdit->setPlaceholderText( "Search presets" );
+  connect(
+    m_queryEdit, SIGNAL(textChanged(QString const &)),
+    this, SLOT(onQueryChanged(QString const &))
+    );
+
+  m_resultList = new QListWidget;
+  m_resultList->hide();
+  connect(
+    m_resultList, SIGNAL(itemActivated(QListWidgetItem *)),
+    this, SLOT(onItemActivated(QListWidgetItem *))
+    );
+
+  m_resultLabel = new QLabel;
+  m_resultLabel->hide();
+
+  m_layout = new QVBoxLayout( this );
+  m_layout->setContentsMargins( 0, 0, 0, 0 );
+  m_layout->addWidget( m_queryEdit );
+  m_layout->addWidget( m_resultLabel );
+  m_layout->addWidget( m_resultList, 1 );
+}
+
+void PresetSearchWidget::setBrowser( QWidget *browser )
+{
+  m_browser = browser;
+  m_layout->addWidget( m_browser, 1 );
+  m_browser->setVisible( m_resultList->isHidden() );
+}
+
+void PresetSearchWidget::rebuild()
+{
+  m_index.beginBuild();
+  m_buildTimer.start();
+}
+
+void PresetSearchWidget::onPresetSaved( QString filePath )
+{
+  std::string presetPath = findPresetPath( filePath );
+  if ( presetPath.empty() )
+  {
+    // saved outside of the namespaces known to the host
+    rebuild();
+    return;
+  }
+
+  m_index.addPreset( presetPath );
+  if ( !m_queryEdit->text().isEmpty() )
+    onQueryChanged( m_queryEdit->text() );
+}
+
+std::string PresetSearchWidget::findPresetPath( QString const &filePath )
+{
+  QFileInfo fileInfo( filePath );
+  QString canonicalFilePath = fileInfo.canonicalFilePath();
+  if ( canonicalFilePath.isEmpty() )
+    return std::string();
+
+  // the namespaces of the preset are the directories above its file, up
+  // to the root of its library: try the nearest ones first
+  QStringList directoryNames =
+    QDir::fromNativeSeparators( fileInfo.absolutePath() )
+      .split( '/', QString::SkipEmptyParts );
+  QString presetPath = fileInfo.completeBaseName();
+  for ( int i = directoryNames.size() - 1; i >= 0; --i )
+  {
+    presetPath = directoryNames[i] + "." + presetPath;
+    QByteArray presetPathUtf8 = presetPath.toUtf8();
+    try
+    {
+      char const *importPathname =
+        m_host.getPresetImportPathname( presetPathUtf8.constData() );
+      if ( importPathname
+        && QFileInfo( QString::fromUtf8( importPathname ) ).canonicalFilePath()
+          == canonicalFilePath )
+        return std::string( presetPathUtf8.constData(), presetPathUtf8.size() );
+    }
+    catch ( FabricCore::Exception e )
+    {
+      // not a preset of the library
+    }
+  }
+  return std::string();
+}
+
+void PresetSearchWidget::buildSlice()
+{
+  QElapsedTimer sliceTimer;
+  sliceTimer.start();
+  while ( m_index.buildStep( m_host ) )
+  {
+    if ( sliceTimer.elapsed() >= s_buildSliceMS )
+      return;
+  }
+
+  m_buildTimer.stop();
+  if ( !m_queryEdit->text().isEmpty() )
+    onQueryChanged( m_queryEdit->text() );
+}
+
+void PresetSearchWidget::onQueryChanged( QString const &query )
+{
+  bool searching = !query.trimmed().isEmpty();
+  m_resultList->setVisible( searching );
+  m_resultLabel->setVisible( searching );
+  if ( m_browser )
+    m_browser->setVisible( !searching );
+  if ( !searching )
+    return;
+
+  QElapsedTimer searchTimer;
+  searchTimer.start();
+
+  std::vector<std::string> presetPaths;
+  m_index.search(
+    query.trimmed().toUtf8().constData(),
+    s_maxResultCount,
+    presetPaths
+    );
+
+  double searchMS = double( searchTimer.nsecsElapsed() ) / 1.0e6;
+
+  m_resultList->clear();
+  for ( size_t i = 0; i < presetPaths.size(); ++i )
+  {
+    QString presetPath = QString::fromUtf8( presetPaths[i].c_str() );
+    QListWidgetItem *item =
+      new QListWidgetItem( presetPath.section( '.', -1 ) );
+    item->setData( Qt::UserRole, presetPath );
+    item->setToolTip( presetPath );
+    m_resultList->addItem( item );
+  }
+  if ( m_resultList->count() > 0 )
+    m_resultList->setCurrentRow( 0 );
+
+  m_resultLabel->setText(
+    QString( m_index.isBuilding()?
+        "%1 of %2 presets indexed so far (%3 ms)":
+        "%1 of %2 presets (%3 ms)" )
+      .arg( presetPaths.size() )
+      .arg( m_index.presetCount() )
+      .arg( searchMS, 0, 'f', 2 )
+    );
+}
+
+void PresetSearchWidget::onItemActivated( QListWidgetItem *item )
+{
+  emit presetActivated( item->data( Qt::UserRole ).toString() );
+}
@@ -0,0 +1,135 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_PRESET_SEARCH_H__
+#define __CANVAS_PRESET_SEARCH_H__
+
+#include <FabricCore.h>
+
+#include <QtCore/QTimer>
+#include <QtGui/QWidget>
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class QLabel;
+class QLineEdit;
+class QListWidget;
+class QListWidgetItem;
+class QVBoxLayout;
+
+// Trigram index over the preset paths of a host. Every preset is listed
+// under each three-character sequence of its lowercased path, so a query
+// only verifies the presets that hold all of its trigrams instead of
+// scanning the whole library.
+class PresetSearchIndex
+{
+public:
+
+  PresetSearchIndex();
+
+  size_t presetCount() const
+    { return m_entries.size(); }
+
+  void clear();
+  // clears the index, and walks the preset namespaces of the host one
+  // buildStep() at a time, so that the walk can be spread over several
+  // turns of the event loop
+  void beginBuild();
+  // indexes the members of one namespace; returns false once the walk
+  // is complete
+  bool buildStep( FabricCore::DFGHost &host );
+  bool isBuilding() const
+    { return !m_pendingNamespaces.empty(); }
+  // adds a preset, unless it is already indexed
+  void addPreset( std::string const &presetPath );
+
+  // the paths of the presets matching all the words of the query,
+  // best first
+  void search(
+    std::string const &query,
+    size_t maxResultCount,
+    std::vector<std::string> &presetPaths
+    ) const;
+
+private:
+
+  struct Entry
+  {
+    std::string path;
+    // lowercased path
+    std::string text;
+    // offset of the name in the path
+    size_t nameOffset;
+  };
+
+  void walk( FabricCore::DFGHost &host, std::string const &namespacePath );
+  int score( Entry const &entry, std::vector<std::string> const &words ) const;
+
+  static uint32_t Trigram( char const *chars );
+
+  std::vector<std::string> m_pendingNamespaces;
+  std::vector<Entry> m_entries;
+  std::map<std::string, uint32_t> m_entryIndices;
+  // entry indices per trigram, in increasing order
+  std::map< uint32_t, std::vector<uint32_t> > m_postings;
+};
+
+// Search box of the Explorer dock. While a query is typed, the ranked
+// results replace the browser (the preset tree) below it. The index is
+// built from the event loop, a few namespaces per turn, once rebuild() is
+// first called; the queries typed meanwhile search the presets indexed so
+// far, and are refreshed once the build completes. A saved preset is added
+// to the index on its own.
+class PresetSearchWidget : public QWidget
+{
+  Q_OBJECT
+
+public:
+
+  PresetSearchWidget( FabricCore::DFGHost const &host, QWidget *parent = NULL );
+
+  // the widget shown while there is no query
+  void setBrowser( QWidget *browser );
+
+signals:
+
+  void presetActivated( QString presetPath );
+
+public slots:
+
+  void rebuild();
+  // adds the preset saved to filePath to the index
+  void onPresetSaved( QString filePath );
+
+private slots:
+
+  void buildSlice();
+  void onQueryChanged( QString const &query );
+  void onItemActivated( QListWidgetItem *item );
+
+private:
+
+  // the dotted path of the preset of the library stored in filePath, or
+  // an empty string if there is none
+  std::string findPresetPath( QString const &filePath );
+
+  static const size_t s_maxResultCount = 200;
+  // time spent building the index per turn of the event loop
+  static const int s_buildSliceMS = 5;
+
+  FabricCore::DFGHost m_host;
+  PresetSearchIndex m_index;
+  QTimer m_buildTimer;
+
+  QVBoxLayout *m_layout;
+  QLineEdit *m_queryEdit;
+  QListWidget *m_resultList;
+  QLabel *m_resultLabel;
+  QWidget *m_browser;
+};
+
+#endif // __CANVAS_PRESET_SEARCH_H__
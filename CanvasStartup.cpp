@@ -0,0 +1,49 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasStartup.h"
+#include "CanvasTrace.h"
+
+#include <stdio.h>
+
+StartupProfiler::StartupProfiler()
+  : m_lastMarkNS( 0 )
+{
+  m_timer.start();
+}
+
+void StartupProfiler::mark( char const *phase )
+{
+  int64_t markNS = m_timer.nsecsElapsed();
+
+  Phase entry;
+  entry.name = phase;
+  entry.elapsedNS = markNS - m_lastMarkNS;
+  m_phases.push_back( entry );
+  m_lastMarkNS = markNS;
+
+  if ( TraceRecorder::IsRecording() )
+  {
+    // the recording may have started during this phase
+    int64_t endNS = TraceRecorder::Now();
+    int64_t beginNS = endNS - entry.elapsedNS;
+    TraceRecorder::Complete( phase, beginNS > 0? beginNS: 0, endNS );
+  }
+}
+
+void StartupProfiler::print() const
+{
+  printf("Startup profile:\n");
+  for ( size_t i = 0; i < m_phases.size(); ++i )
+  {
+    Phase const &phase = m_phases[i];
+    printf(
+      "  %-20s %8.1f ms  %5.1f%%\n",
+      phase.name,
+      double( phase.elapsedNS ) / 1.0e6,
+      m_lastMarkNS > 0? 100.0 * double( phase.elapsedNS ) / double( m_lastMarkNS ): 0.0
+      );
+  }
+  printf("  %-20s %8.1f ms\n", "total", double( m_lastMarkNS ) / 1.0e6);
+}
@@ -0,0 +1,40 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_STARTUP_H__
+#define __CANVAS_STARTUP_H__
+
+#include <QtCore/QElapsedTimer>
+
+#include <stdint.h>
+#include <vector>
+
+// Splits the time from process start to the first drawn frame into named
+// phases, for --startup-profile. Each mark closes the phase that began at
+// the previous one. The phases are also recorded in the trace, if any.
+class StartupProfiler
+{
+public:
+
+  StartupProfiler();
+
+  // name must be a string literal
+  void mark( char const *phase );
+
+  void print() const;
+
+private:
+
+  struct Phase
+  {
+    char const *name;
+    int64_t elapsedNS;
+  };
+
+  QElapsedTimer m_timer;
+  int64_t m_lastMarkNS;
+  std::vector<Phase> m_phases;
+};
+
+#endif // __CANVAS_STARTUP_H__
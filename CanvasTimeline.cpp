@@ -0,0 +1,125 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasTimeline.h"
+
+TimelinePort::TimelinePort()
+  : m_index( -1 )
+  , m_type( Type_None )
+{
+}
+
+TimelinePort::TimelinePort( TimelinePort const &other )
+  : m_index( other.m_index )
+  , m_type( other.m_type )
+{
+}
+
+TimelinePort &TimelinePort::operator=( TimelinePort const &other )
+{
+  if ( m_index != other.m_index || m_type != other.m_type )
+  {
+    m_index = other.m_index;
+    m_type = other.m_type;
+    m_value = FabricCore::RTVal();
+  }
+  return *this;
+}
+
+void TimelinePort::reset()
+{
+  m_index = -1;
+  m_type = Type_None;
+  m_value = FabricCore::RTVal();
+}
+
+TimelinePort::Type TimelinePort::ResolveType(
+  FabricCore::DFGExec &exec,
+  unsigned index
+  )
+{
+  if ( exec.isExecPortResolvedType( index, "SInt32" ) )
+    return Type_SInt32;
+  if ( exec.isExecPortResolvedType( index, "UInt32" ) )
+    return Type_UInt32;
+  if ( exec.isExecPortResolvedType( index, "Float32" ) )
+    return Type_Float32;
+  if ( exec.isExecPortResolvedType( index, "Float64" ) )
+    return Type_Float64;
+  return Type_None;
+}
+
+void TimelinePort::resolve(
+  FabricCore::DFGExec &exec,
+  RootPortMap &ports
+  )
+{
+  reset();
+
+  int index = ports.findInput( exec, "timeline" );
+  if ( index < 0 )
+    return;
+  Type type = ResolveType( exec, unsigned( index ) );
+  if ( type == Type_None )
+    return;
+  m_index = index;
+  m_type = type;
+}
+
+FabricCore::RTVal TimelinePort::frameValue(
+  FabricCore::Client const &client,
+  int frame
+  )
+{
+  if ( !m_value.isValid() )
+  {
+    switch ( m_type )
+    {
+      case Type_SInt32:
+        m_value = FabricCore::RTVal::ConstructSInt32( client, frame );
+        break;
+      case Type_UInt32:
+        m_value = FabricCore::RTVal::ConstructUInt32( client, frame );
+        break;
+      case Type_Float32:
+        m_value = FabricCore::RTVal::ConstructFloat32( client, float( frame ) );
+        break;
+      case Type_Float64:
+        m_value = FabricCore::RTVal::ConstructFloat64( client, double( frame ) );
+        break;
+      case Type_None:
+        break;
+    }
+    return m_value;
+  }
+
+  switch ( m_type )
+  {
+    case Type_SInt32:
+      m_value.setSInt32( frame );
+      break;
+    case Type_UInt32:
+      m_value.setUInt32( uint32_t( frame ) );
+      break;
+    case Type_Float32:
+      m_value.setFloat32( float( frame ) );
+      break;
+    case Type_Float64:
+      m_value.setFloat64( double( frame ) );
+      break;
+    case Type_None:
+      break;
+  }
+  return m_value;
+}
+
+void TimelinePort::setFrame(
+  FabricCore::Client const &client,
+  FabricCore::DFGBinding &binding,
+  int frame
+  )
+{
+  if ( isSet() )
+    binding.setArgValue( m_index, frameValue( client, frame ), false );
+}
@@ -0,0 +1,68 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_TIMELINE_H__
+#define __CANVAS_TIMELINE_H__
+
+#include "CanvasPorts.h"
+
+#include <FabricCore.h>
+
+// The root input port named "timeline" that follows the current frame.
+// Its type is resolved once, when the structure of the graph changes, so
+// that driving it on every frame needs no lookup or type comparison. The
+// value is constructed once and updated in place for each frame; copies do
+// not share it, so that each copy can be driven from its own thread.
+class TimelinePort
+{
+public:
+
+  enum Type
+  {
+    Type_None,
+    Type_SInt32,
+    Type_UInt32,
+    Type_Float32,
+    Type_Float64
+  };
+
+  TimelinePort();
+  TimelinePort( TimelinePort const &other );
+  TimelinePort &operator=( TimelinePort const &other );
+
+  // finds the port in exec; the port is left unset if exec has no
+  // "timeline" input of one of the supported types
+  void resolve( FabricCore::DFGExec &exec, RootPortMap &ports );
+  void reset();
+
+  bool isSet() const
+    { return m_type != Type_None; }
+  int index() const
+    { return m_index; }
+  Type type() const
+    { return m_type; }
+
+  static Type ResolveType( FabricCore::DFGExec &exec, unsigned index );
+
+  // the value of the port at the frame; the returned value is updated by
+  // the next call
+  FabricCore::RTVal frameValue(
+    FabricCore::Client const &client,
+    int frame
+    );
+
+  void setFrame(
+    FabricCore::Client const &client,
+    FabricCore::DFGBinding &binding,
+    int frame
+    );
+
+private:
+
+  int m_index;
+  Type m_type;
+  FabricCore::RTVal m_value;
+};
+
+#endif // __CANVAS_TIMELINE_H__
@@ -0,0 +1,236 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasTrace.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QThreadStorage>
+
+#include <stdio.h>
+#include <vector>
+
+namespace {
+
+struct TraceEvent
+{
+  char phase;
+  char const *name;
+  int64_t timestampNS;
+  int64_t durationNS;
+  std::string detail;
+};
+
+struct TraceBuffer
+{
+  int threadId;
+  std::string threadName;
+  // set while the owning thread appends, so that Stop() can wait
+  // for it before reading the events
+  QAtomicInt appending;
+  std::vector<TraceEvent> events;
+};
+
+struct TraceThreadSlot
+{
+  TraceBuffer *buffer;
+
+  TraceThreadSlot()
+    : buffer( 0 )
+  {
+  }
+};
+
+}
+
+QAtomicInt TraceRecorder::s_recording( 0 );
+
+// the buffers are never freed: a thread keeps its buffer for its lifetime
+// and reuses it for the next recording
+static QMutex sBuffersMutex;
+static std::vector<TraceBuffer *> sBuffers;
+static QThreadStorage<TraceThreadSlot> sThreadSlot;
+static QElapsedTimer sClock;
+
+static TraceBuffer *GetThreadBuffer()
+{
+  TraceThreadSlot &slot = sThreadSlot.localData();
+  if ( !slot.buffer )
+  {
+    TraceBuffer *buffer = new TraceBuffer;
+    QCoreApplication *app = QCoreApplication::instance();
+    QMutexLocker locker( &sBuffersMutex );
+    buffer->threadId = int( sBuffers.size() ) + 1;
+    if ( app && QThread::currentThread() == app->thread() )
+      buffer->threadName = "UI";
+    else
+      buffer->threadName =
+        "Worker " + QString::number( buffer->threadId ).toStdString();
+    sBuffers.push_back( buffer );
+    slot.buffer = buffer;
+  }
+  return slot.buffer;
+}
+
+int64_t TraceRecorder::Now()
+{
+  return sClock.nsecsElapsed();
+}
+
+void TraceRecorder::Record(
+  char phase,
+  char const *name,
+  int64_t timestampNS,
+  int64_t durationNS,
+  std::string const &detail
+  )
+{
+  TraceBuffer *buffer = GetThreadBuffer();
+  buffer->appending.fetchAndStoreOrdered( 1 );
+  if ( IsRecording() )
+  {
+    TraceEvent event;
+    event.phase = phase;
+    event.name = name;
+    event.timestampNS = timestampNS;
+    event.durationNS = durationNS;
+    event.detail = detail;
+    buffer->events.push_back( event );
+  }
+  buffer->appending.fetchAndStoreOrdered( 0 );
+}
+
+void TraceRecorder::Complete(
+  char const *name,
+  int64_t beginNS,
+  int64_t endNS
+  )
+{
+  if ( IsRecording() )
+    Record( 'X', name, beginNS, endNS - beginNS, std::string() );
+}
+
+void TraceRecorder::Begin( char const *name, std::string const &detail )
+{
+  if ( IsRecording() )
+    Record( 'B', name, Now(), 0, detail );
+}
+
+void TraceRecorder::End( char const *name )
+{
+  if ( IsRecording() )
+    Record( 'E', name, Now(), 0, std::string() );
+}
+
+void TraceRecorder::Instant( char const *name, std::string const &detail )
+{
+  if ( IsRecording() )
+    Record( 'i', name, Now(), 0, detail );
+}
+
+void TraceRecorder::Start()
+{
+  if ( IsRecording() )
+    return;
+
+  {
+    QMutexLocker locker( &sBuffersMutex );
+    for ( size_t i = 0; i < sBuffers.size(); ++i )
+      sBuffers[i]->events.clear();
+  }
+
+  sClock.start();
+  s_recording.fetchAndStoreOrdered( 1 );
+}
+
+static void WriteJSONString( FILE *file, std::string const &value )
+{
+  fputc( '"', file );
+  for ( size_t i = 0; i < value.size(); ++i )
+  {
+    unsigned char c = value[i];
+    if ( c == '"' || c == '\\' )
+      fprintf( file, "\\%c", c );
+    else if ( c < 0x20 )
+      fprintf( file, "\\u%04x", unsigned( c ) );
+    else
+      fputc( c, file );
+  }
+  fputc( '"', file );
+}
+
+bool TraceRecorder::Stop( std::string const &filePath )
+{
+  s_recording.fetchAndStoreOrdered( 0 );
+
+  QMutexLocker locker( &sBuffersMutex );
+
+  // an event started before the flag was cleared may still be
+  // being appended
+  for ( size_t i = 0; i < sBuffers.size(); ++i )
+  {
+    while ( int( sBuffers[i]->appending ) != 0 )
+      QThread::yieldCurrentThread();
+  }
+
+  if ( filePath.empty() )
+    return true;
+
+  FILE *file = fopen( filePath.c_str(), "w" );
+  if ( !file )
+    return false;
+
+  fprintf( file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+  bool first = true;
+  for ( size_t i = 0; i < sBuffers.size(); ++i )
+  {
+    TraceBuffer const *buffer = sBuffers[i];
+    if ( buffer->events.empty() )
+      continue;
+
+    fprintf(
+      file,
+      "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+      first? "": ",\n",
+      buffer->threadId
+      );
+    WriteJSONString( file, buffer->threadName );
+    fprintf( file, "}}" );
+    first = false;
+
+    for ( size_t j = 0; j < buffer->events.size(); ++j )
+    {
+      TraceEvent const &event = buffer->events[j];
+      fprintf( file, ",\n{\"name\":" );
+      WriteJSONString( file, event.name );
+      fprintf(
+        file,
+        ",\"cat\":\"canvas\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f",
+        event.phase,
+        buffer->threadId,
+        double( event.timestampNS ) / 1.0e3
+        );
+      if ( event.phase == 'X' )
+        fprintf( file, ",\"dur\":%.3f", double( event.durationNS ) / 1.0e3 );
+      else if ( event.phase == 'i' )
+        fprintf( file, ",\"s\":\"t\"" );
+      if ( !event.detail.empty() )
+      {
+        fprintf( file, ",\"args\":{\"detail\":" );
+        WriteJSONString( file, event.detail );
+        fprintf( file, "}" );
+      }
+      fprintf( file, "}" );
+    }
+  }
+  fprintf( file, "\n]}\n" );
+
+  bool succeeded = ferror( file ) == 0;
+  if ( fclose( file ) != 0 )
+    succeeded = false;
+  return succeeded;
+}
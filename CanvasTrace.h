@@ -0,0 +1,84 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_TRACE_H__
+#define __CANVAS_TRACE_H__
+
+#include <QtCore/QAtomicInt>
+
+#include <stdint.h>
+#include <string>
+
+// Records spans and instant events in the Trace Event Format, which
+// chrome://tracing and Perfetto open directly. Each thread appends to its
+// own buffer, so recording takes no lock; the buffers are merged when the
+// trace is written. While recording is off, a scope costs one load.
+class TraceRecorder
+{
+public:
+
+  static bool IsRecording()
+    { return int( s_recording ) != 0; }
+
+  // drops the events of the previous recording
+  static void Start();
+  // stops recording and writes the trace; returns false if the file
+  // could not be written
+  static bool Stop( std::string const &filePath );
+
+  // name must be a string literal, or otherwise outlive the recording
+  static void Complete(
+    char const *name,
+    int64_t beginNS,
+    int64_t endNS
+    );
+  static void Begin( char const *name, std::string const &detail );
+  static void End( char const *name );
+  static void Instant( char const *name, std::string const &detail );
+
+  // nanoseconds since the recording started
+  static int64_t Now();
+
+private:
+
+  static void Record(
+    char phase,
+    char const *name,
+    int64_t timestampNS,
+    int64_t durationNS,
+    std::string const &detail
+    );
+
+  static QAtomicInt s_recording;
+};
+
+// Records a span covering the rest of the enclosing scope.
+class TraceScope
+{
+public:
+
+  TraceScope( char const *name )
+    : m_name( TraceRecorder::IsRecording()? name: 0 )
+    , m_beginNS( m_name? TraceRecorder::Now(): 0 )
+  {
+  }
+
+  ~TraceScope()
+  {
+    if ( m_name )
+      TraceRecorder::Complete( m_name, m_beginNS, TraceRecorder::Now() );
+  }
+
+private:
+
+  char const *m_name;
+  int64_t m_beginNS;
+};
+
+#define CANVAS_TRACE_CONCAT_IMPL( a, b ) a##b
+#define CANVAS_TRACE_CONCAT( a, b ) CANVAS_TRACE_CONCAT_IMPL( a, b )
+#define CANVAS_TRACE_SCOPE( name ) \
+  TraceScope CANVAS_TRACE_CONCAT( canvasTraceScope, __LINE__ )( name )
+
+#endif // __CANVAS_TRACE_H__
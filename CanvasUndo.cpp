@@ -0,0 +1,319 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#include "CanvasUndo.h"
+#include "CanvasFrameCache.h"
+
+#include <stdio.h>
+
+BudgetedCmdHandler::BudgetedCmdHandler( QUndoStack *qUndoStack )
+  : FabricUI::DFG::DFGUICmdHandler_QUndo( qUndoStack )
+  , m_qUndoStack( qUndoStack )
+  , m_executor( NULL )
+  , m_rootPorts( NULL )
+  , m_budgetBytes( 0 )
+  , m_mergeIntervalMS( 0 )
+  , m_usedBytes( 0 )
+  , m_lastSetCommand( NULL )
+  , m_hasMergedSets( false )
+  , m_lastIndex( 0 )
+  , m_lastRedoCommand( NULL )
+{
+  m_mergeTimer.setSingleShot( true );
+  connect( &m_mergeTimer, SIGNAL(timeout()), this, SLOT(commitMergedSets()) );
+  // an undo, or another command, ends the merging
+  connect(
+    m_qUndoStack, SIGNAL(indexChanged(int)),
+    this, SLOT(commitMergedSets())
+    );
+  connect(
+    m_qUndoStack, SIGNAL(indexChanged(int)),
+    this, SLOT(onIndexChanged(int))
+    );
+}
+
+void BudgetedCmdHandler::onIndexChanged( int index )
+{
+  // a push adds a new command right below the index; anything else
+  // (an undo, a redo, a cleared or trimmed history) can change the root
+  // ports in ways the map does not follow
+  bool isPush = index == m_lastIndex + 1
+    && index == m_qUndoStack->count()
+    && m_qUndoStack->command( index - 1 ) != m_lastRedoCommand;
+  if ( !isPush && m_rootPorts )
+    m_rootPorts->clear();
+
+  m_lastIndex = index;
+  m_lastRedoCommand = index < m_qUndoStack->count()
+    ? m_qUndoStack->command( index )
+    : NULL;
+}
+
+std::string BudgetedCmdHandler::dfgDoAddPort(
+  FabricCore::DFGBinding const &binding,
+  FTL::CStrRef execPath,
+  FabricCore::DFGExec const &exec,
+  FTL::CStrRef desiredPortName,
+  FabricCore::DFGPortType portType,
+  FTL::CStrRef typeSpec,
+  FTL::CStrRef portToConnect,
+  FTL::StrRef extDep,
+  FTL::CStrRef metaData
+  )
+{
+  std::string portName =
+    FabricUI::DFG::DFGUICmdHandler_QUndo::dfgDoAddPort(
+      binding, execPath, exec, desiredPortName, portType, typeSpec,
+      portToConnect, extDep, metaData
+      );
+  if ( m_rootPorts && execPath.empty() && !portName.empty() )
+  {
+    FabricCore::DFGExec mutableExec = exec;
+    m_rootPorts->onPortAdded( mutableExec, portName.c_str(), portType );
+  }
+  return portName;
+}
+
+void BudgetedCmdHandler::dfgDoRemovePort(
+  FabricCore::DFGBinding const &binding,
+  FTL::CStrRef execPath,
+  FabricCore::DFGExec const &exec,
+  FTL::CStrRef portName
+  )
+{
+  // the name may refer to the removed port's storage
+  std::string removedPortName = portName.c_str();
+  FabricUI::DFG::DFGUICmdHandler_QUndo::dfgDoRemovePort(
+    binding, execPath, exec, portName
+    );
+  if ( m_rootPorts && execPath.empty() )
+    m_rootPorts->onPortRemoved( removedPortName.c_str() );
+}
+
+std::string BudgetedCmdHandler::dfgDoRenamePort(
+  FabricCore::DFGBinding const &binding,
+  FTL::CStrRef execPath,
+  FabricCore::DFGExec const &exec,
+  FTL::CStrRef portName,
+  FTL::CStrRef desiredNewName
+  )
+{
+  std::string oldPortName = portName.c_str();
+  std::string newPortName =
+    FabricUI::DFG::DFGUICmdHandler_QUndo::dfgDoRenamePort(
+      binding, execPath, exec, portName, desiredNewName
+      );
+  if ( m_rootPorts && execPath.empty() && !newPortName.empty() )
+    m_rootPorts->onPortRenamed( oldPortName.c_str(), newPortName.c_str() );
+  return newPortName;
+}
+
+std::string BudgetedCmdHandler::dfgDoEditPort(
+  FabricCore::DFGBinding const &binding,
+  FTL::CStrRef execPath,
+  FabricCore::DFGExec const &exec,
+  FTL::StrRef oldPortName,
+  FTL::StrRef desiredNewPortName,
+  FTL::StrRef typeSpec,
+  FTL::StrRef extDep,
+  FTL::StrRef uiMetadata
+  )
+{
+  std::string oldName( oldPortName.data(), oldPortName.size() );
+  std::string newPortName =
+    FabricUI::DFG::DFGUICmdHandler_QUndo::dfgDoEditPort(
+      binding, execPath, exec, oldPortName, desiredNewPortName,
+      typeSpec, extDep, uiMetadata
+      );
+  // the type is resolved again by the lookups; only the name matters
+  if ( m_rootPorts && execPath.empty() && !newPortName.empty()
+    && newPortName != oldName )
+    m_rootPorts->onPortRenamed( oldName.c_str(), newPortName.c_str() );
+  return newPortName;
+}
+
+void BudgetedCmdHandler::sync()
+{
+  // the commands are compared rather than counted: a push that replaces
+  // a redo entry leaves the count unchanged
+  size_t count = size_t( m_qUndoStack->count() );
+  size_t keptCount = 0;
+  while ( keptCount < m_commandSizes.size() && keptCount < count
+    && m_commandSizes[keptCount].command
+      == m_qUndoStack->command( int( keptCount ) ) )
+    ++keptCount;
+
+  while ( m_commandSizes.size() > keptCount )
+  {
+    m_usedBytes -= m_commandSizes.back().bytes;
+    m_commandSizes.pop_back();
+  }
+  for ( size_t i = keptCount; i < count; ++i )
+  {
+    CommandSize commandSize;
+    commandSize.command = m_qUndoStack->command( int( i ) );
+    commandSize.bytes = s_commandBytes;
+    m_commandSizes.push_back( commandSize );
+    m_usedBytes += s_commandBytes;
+  }
+}
+
+uint64_t BudgetedCmdHandler::usedBytes()
+{
+  sync();
+  return m_usedBytes;
+}
+
+bool BudgetedCmdHandler::isMacroOpen() const
+{
+  // an open macro is on the stack, but can neither be undone nor redone
+  return m_qUndoStack->index() < m_qUndoStack->count()
+    && !m_qUndoStack->canRedo();
+}
+
+void BudgetedCmdHandler::pushSetArgValue(
+  FabricCore::DFGBinding const &binding,
+  FTL::CStrRef argName,
+  FabricCore::RTVal const &value
+  )
+{
+  sync();
+
+  FabricUI::DFG::DFGUICmdHandler_QUndo::dfgDoSetArgValue(
+    binding, argName, value
+    );
+
+  sync();
+
+  m_lastSetCommand = NULL;
+  int index = m_qUndoStack->index();
+  if ( index > 0 && index == m_qUndoStack->count() )
+  {
+    // the core keeps both the previous and the new value
+    uint64_t bytes = s_commandBytes + 2 * FrameCache::EstimateBytes( value );
+    m_usedBytes += bytes - m_commandSizes[index - 1].bytes;
+    m_commandSizes[index - 1].bytes = bytes;
+
+    m_lastSetCommand = m_qUndoStack->command( index - 1 );
+    m_lastSetArgName = argName.c_str();
+    m_lastSetTimer.start();
+  }
+  else if ( !m_commandSizes.empty() )
+  {
+    // part of a macro
+    uint64_t bytes = 2 * FrameCache::EstimateBytes( value );
+    m_commandSizes.back().bytes += bytes;
+    m_usedBytes += bytes;
+  }
+}
+
+void BudgetedCmdHandler::dfgDoSetArgValue(
+  FabricCore::DFGBinding const &binding,
+  FTL::CStrRef argName,
+  FabricCore::RTVal const &value
+  )
+{
+  if ( m_hasMergedSets && m_lastSetArgName != argName.c_str() )
+    commitMergedSets();
+
+  // the previous set must still be the last command, with nothing to
+  // redo and no macro open
+  int index = m_qUndoStack->index();
+  bool merge = m_mergeIntervalMS > 0
+    && m_lastSetCommand
+    && index > 0
+    && index == m_qUndoStack->count()
+    && m_qUndoStack->command( index - 1 ) == m_lastSetCommand
+    && m_lastSetArgName == argName.c_str()
+    && m_lastSetTimer.elapsed() < qint64( m_mergeIntervalMS );
+  if ( !merge )
+  {
+    pushSetArgValue( binding, argName, value );
+    return;
+  }
+
+  try
+  {
+    FabricCore::DFGBinding mutableBinding = binding;
+    if ( !m_hasMergedSets )
+    {
+      // the value the first command set, which its redo restores
+      m_mergedFirstValue =
+        mutableBinding.getArgValue( argName.c_str() ).copy();
+      m_mergedBinding = binding;
+      m_hasMergedSets = true;
+    }
+    mutableBinding.setArgValue( argName.c_str(), value, false );
+    m_mergedLastValue = value.copy();
+  }
+  catch ( FabricCore::Exception e )
+  {
+    printf("Exception: %s\n", e.getDesc_cstr());
+  }
+
+  m_lastSetTimer.start();
+  m_mergeTimer.start( int( m_mergeIntervalMS ) );
+}
+
+void BudgetedCmdHandler::commitMergedSets()
+{
+  if ( !m_hasMergedSets )
+    return;
+
+  // the undo and the push below change the index as well
+  m_hasMergedSets = false;
+  m_mergeTimer.stop();
+
+  FabricCore::DFGBinding binding = m_mergedBinding;
+  FabricCore::RTVal firstValue = m_mergedFirstValue;
+  FabricCore::RTVal lastValue = m_mergedLastValue;
+  m_mergedBinding = FabricCore::DFGBinding();
+  m_mergedFirstValue = FabricCore::RTVal();
+  m_mergedLastValue = FabricCore::RTVal();
+
+  int firstIndex = -1;
+  for ( int i = m_qUndoStack->count(); i-- > 0; )
+  {
+    if ( m_qUndoStack->command( i ) == m_lastSetCommand )
+    {
+      firstIndex = i;
+      break;
+    }
+  }
+  // the first command was undone, which restored the value from before
+  // the sets, or the history was cleared
+  int index = m_qUndoStack->index();
+  if ( firstIndex < 0 || firstIndex >= index || isMacroOpen() )
+  {
+    m_lastSetCommand = NULL;
+    return;
+  }
+
+  if ( m_executor )
+    m_executor->waitForIdle();
+
+  std::string argName = m_lastSetArgName;
+  try
+  {
+    if ( firstIndex == index - 1 && index == m_qUndoStack->count() )
+    {
+      // a single undo for the whole burst
+      m_qUndoStack->undo();
+    }
+    else
+    {
+      // other commands came after the first one; the new command goes
+      // from its value to the last one
+      binding.setArgValue( argName.c_str(), firstValue, false );
+    }
+    pushSetArgValue( binding, argName, lastValue );
+  }
+  catch ( FabricCore::Exception e )
+  {
+    printf("Exception: %s\n", e.getDesc_cstr());
+  }
+
+  // the next set starts a new command
+  m_lastSetCommand = NULL;
+}
@@ -0,0 +1,166 @@
+//
+// Copyright 2010-2015 Fabric Software Inc. All rights reserved.
+//
+
+#ifndef __CANVAS_UNDO_H__
+#define __CANVAS_UNDO_H__
+
+#include "CanvasExecutor.h"
+#include "CanvasPorts.h"
+
+#include <FabricUI/DFG/DFGUICmdHandler_QUndo.h>
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+#include <QtGui/QUndoStack>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Command handler that keeps track of the memory held by the undo
+// history. The payload of each argument value set is estimated as it is
+// pushed; the other commands are counted at a fixed size.
+//
+// Consecutive sets of the same argument within the merge interval are
+// merged: the first one is pushed as usual, the following ones are set
+// without undo records, and once they stop for the merge interval the
+// first command is replaced by one going from the value before the first
+// set to the last value.
+//
+// The commands that add, remove or rename ports of the root exec are
+// reported to the root port map; an undo or a redo marks it stale.
+class BudgetedCmdHandler : public QObject,
+  public FabricUI::DFG::DFGUICmdHandler_QUndo
+{
+  Q_OBJECT
+
+public:
+
+  BudgetedCmdHandler( QUndoStack *qUndoStack );
+
+  void setBudget( uint64_t budgetBytes )
+    { m_budgetBytes = budgetBytes; }
+  uint64_t budget() const
+    { return m_budgetBytes; }
+  // 0 disables the merging
+  void setMergeIntervalMS( unsigned mergeIntervalMS )
+    { m_mergeIntervalMS = mergeIntervalMS; }
+  // the merged sets are committed from a timer, outside of the user
+  // input that the executor's input gate holds back
+  void setExecutor( GraphExecutor *executor )
+    { m_executor = executor; }
+  void setRootPorts( RootPortMap *rootPorts )
+    { m_rootPorts = rootPorts; }
+
+  // estimate of the memory held by the commands on the stack, including
+  // the ones that can be redone
+  uint64_t usedBytes();
+  bool isOverBudget()
+    { return m_budgetBytes > 0 && usedBytes() > m_budgetBytes; }
+
+public slots:
+
+  // pushes the undo command of the sets merged so far, if any
+  void commitMergedSets();
+
+protected:
+
+  virtual void dfgDoSetArgValue(
+    FabricCore::DFGBinding const &binding,
+    FTL::CStrRef argName,
+    FabricCore::RTVal const &value
+    );
+
+  virtual std::string dfgDoAddPort(
+    FabricCore::DFGBinding const &binding,
+    FTL::CStrRef execPath,
+    FabricCore::DFGExec const &exec,
+    FTL::CStrRef desiredPortName,
+    FabricCore::DFGPortType portType,
+    FTL::CStrRef typeSpec,
+    FTL::CStrRef portToConnect,
+    FTL::StrRef extDep,
+    FTL::CStrRef metaData
+    );
+
+  virtual void dfgDoRemovePort(
+    FabricCore::DFGBinding const &binding,
+    FTL::CStrRef execPath,
+    FabricCore::DFGExec const &exec,
+    FTL::CStrRef portName
+    );
+
+  virtual std::string dfgDoRenamePort(
+    FabricCore::DFGBinding const &binding,
+    FTL::CStrRef execPath,
+    FabricCore::DFGExec const &exec,
+    FTL::CStrRef portName,
+    FTL::CStrRef desiredNewName
+    );
+
+  virtual std::string dfgDoEditPort(
+    FabricCore::DFGBinding const &binding,
+    FTL::CStrRef execPath,
+    FabricCore::DFGExec const &exec,
+    FTL::StrRef oldPortName,
+    FTL::StrRef desiredNewPortName,
+    FTL::StrRef typeSpec,
+    FTL::StrRef extDep,
+    FTL::StrRef uiMetadata
+    );
+
+private slots:
+
+  // tells the pushes apart from the undos and redos
+  void onIndexChanged( int index );
+
+private:
+
+  static const uint64_t s_commandBytes = 256;
+
+  struct CommandSize
+  {
+    QUndoCommand const *command;
+    uint64_t bytes;
+  };
+
+  // follows the commands pushed, undone or cleared by others
+  void sync();
+  bool isMacroOpen() const;
+  // pushes the command through the base handler and estimates its size
+  void pushSetArgValue(
+    FabricCore::DFGBinding const &binding,
+    FTL::CStrRef argName,
+    FabricCore::RTVal const &value
+    );
+
+  QUndoStack *m_qUndoStack;
+  GraphExecutor *m_executor;
+  RootPortMap *m_rootPorts;
+  uint64_t m_budgetBytes;
+  unsigned m_mergeIntervalMS;
+
+  // estimated size of each command on the stack
+  std::vector<CommandSize> m_commandSizes;
+  uint64_t m_usedBytes;
+
+  // the last argument value set, while it can be merged with
+  QUndoCommand const *m_lastSetCommand;
+  std::string m_lastSetArgName;
+  QElapsedTimer m_lastSetTimer;
+
+  // the sets made without undo records since m_lastSetCommand
+  bool m_hasMergedSets;
+  FabricCore::DFGBinding m_mergedBinding;
+  FabricCore::RTVal m_mergedFirstValue;
+  FabricCore::RTVal m_mergedLastValue;
+  QTimer m_mergeTimer;
+
+  // the command a redo would run, as of the last index change
+  int m_lastIndex;
+  QUndoCommand const *m_lastRedoCommand;
+};
+
+#endif // __CANVAS_UNDO_H__